@@ -7,8 +7,6 @@
 
 /* endian-ness checking */
 static const int __ENDIAN_CHECK__ = 1;
-static int BigEndian;
-static int LittleEndian;
 
 
 /* global initialisation for libraries */
@@ -20,36 +18,89 @@ void LibraryInit(Picoc *pc)
     VariableDefinePlatformVar(pc, NULL, "PICOC_VERSION", pc->CharPtrType, (union AnyValue *)&pc->VersionString, FALSE);
 
     /* define endian-ness macros */
-    BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
-    LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
+    pc->BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
+    pc->LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
 
-    VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType, (union AnyValue *)&BigEndian, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType, (union AnyValue *)&LittleEndian, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType, (union AnyValue *)&pc->BigEndian, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType, (union AnyValue *)&pc->LittleEndian, FALSE);
 }
 
-/* add a library */
+/* find the name a library function prototype defines - the identifier before its parameters */
+static char *LibraryPrototypeName(Picoc *pc, const char *Prototype)
+{
+    const char *End = strchr(Prototype, '(');
+    const char *Start;
+    
+    while (End > Prototype && isspace((unsigned char)End[-1]))
+        End--;
+    
+    for (Start = End; Start > Prototype && (isalnum((unsigned char)Start[-1]) || Start[-1] == '_'); Start--)
+    {}
+    
+    return TableStrRegister2(pc, Start, End - Start);
+}
+
+/* add a library. the prototypes aren't parsed yet since most programs only call a 
+ * few of the library functions - each function is added as a placeholder holding 
+ * its prototype which LibraryResolve() parses the first time it's looked up */
 void LibraryAdd(Picoc *pc, struct Table *GlobalTable, const char *LibraryName, struct LibraryFunction *FuncList)
 {
-    struct ParseState Parser;
     int Count;
     char *Identifier;
-    struct ValueType *ReturnType;
     struct Value *NewValue;
-    void *Tokens;
     char *IntrinsicName = TableStrRegister(pc, "c library");
     
     /* read all the library definitions */
     for (Count = 0; FuncList[Count].Prototype != NULL; Count++)
     {
-        Tokens = LexAnalyse(pc, IntrinsicName, FuncList[Count].Prototype, strlen((char *)FuncList[Count].Prototype), NULL);
-        LexInitParser(&Parser, pc, FuncList[Count].Prototype, Tokens, IntrinsicName, TRUE, FALSE);
-        TypeParse(&Parser, &ReturnType, &Identifier, NULL);
-        NewValue = ParseFunctionDefinition(&Parser, ReturnType, Identifier);
+        Identifier = LibraryPrototypeName(pc, FuncList[Count].Prototype);
+        NewValue = VariableAllocValueAndData(pc, NULL, sizeof(struct FuncDef), FALSE, NULL, TRUE);
+        NewValue->Typ = &pc->FunctionType;
+        NewValue->Val->FuncDef.ReturnType = NULL;     /* not parsed yet */
         NewValue->Val->FuncDef.Intrinsic = FuncList[Count].Func;
-        HeapFreeMem(pc, Tokens);
+        NewValue->Val->FuncDef.Body.FileName = IntrinsicName;
+        NewValue->Val->FuncDef.Body.SourceText = FuncList[Count].Prototype;
+        NewValue->Val->FuncDef.Body.Pos = NULL;
+        NewValue->ScopeID = SCOPE_ID_NONE;      /* library functions are never out of scope */
+        
+        if (!TableSet(pc, GlobalTable, Identifier, NewValue, IntrinsicName, 0, 0))
+            ProgramFailNoParser(pc, "'%s' is already defined", Identifier);
     }
 }
 
+/* parse the prototype of a library function placeholder, replacing it with the real definition */
+struct Value *LibraryResolve(Picoc *pc, const char *Identifier, struct Value *FuncValue)
+{
+    struct ParseState Parser;
+    char *Name;
+    struct ValueType *ReturnType;
+    void *Tokens;
+    char *IntrinsicName = FuncValue->Val->FuncDef.Body.FileName;
+    const char *Prototype = FuncValue->Val->FuncDef.Body.SourceText;
+    void (*Intrinsic)() = FuncValue->Val->FuncDef.Intrinsic;
+    struct StackFrame *TopStackFrame = pc->TopStackFrame;
+    struct ValueType *LexType = pc->LexValue.Typ;
+    union AnyValue LexData = pc->LexAnyValue;
+    
+    VariableFree(pc, TableDelete(pc, &pc->GlobalTable, Identifier));
+    
+    /* it's a global definition even if we're in the middle of running a function. 
+     * the lexer's current value belongs to whoever looked the function up */
+    pc->TopStackFrame = NULL;
+    Tokens = LexAnalyse(pc, IntrinsicName, Prototype, strlen(Prototype), NULL);
+    LexInitParser(&Parser, pc, Prototype, Tokens, IntrinsicName, TRUE, FALSE);
+    TypeParse(&Parser, &ReturnType, &Name, NULL);
+    FuncValue = ParseFunctionDefinition(&Parser, ReturnType, Name);
+    FuncValue->Val->FuncDef.Intrinsic = Intrinsic;
+    FuncValue->ScopeID = SCOPE_ID_NONE;
+    HeapFreeMem(pc, Tokens);
+    
+    pc->TopStackFrame = TopStackFrame;
+    pc->LexValue.Typ = LexType;
+    pc->LexAnyValue = LexData;
+    return FuncValue;
+}
+
 /* print a type to a stream without using printf/sprintf */
 void PrintType(struct ValueType *Typ, IOFILE *Stream)
 {
@@ -89,8 +140,8 @@ void PrintType(struct ValueType *Typ, IOFILE *Stream)
  * A more complete standard library for larger computers is in the library_XXX.c files.
  */
  
-static int TRUEValue = 1;
-static int ZeroValue = 0;
+static const int TRUEValue = 1;
+static const int ZeroValue = 0;
 
 void BasicIOInit(Picoc *pc)
 {
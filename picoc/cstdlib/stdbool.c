@@ -3,8 +3,8 @@
 
 #ifndef BUILTIN_MINI_STDLIB
 
-static int trueValue = 1;
-static int falseValue = 0;
+static const int trueValue = 1;
+static const int falseValue = 0;
 
 
 /* structure definitions */
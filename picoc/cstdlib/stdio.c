@@ -7,22 +7,18 @@
 #define MAX_FORMAT 80
 #define MAX_SCANF_ARGS 10
 
-static int Stdio_ZeroValue = 0;
-static int EOFValue = EOF;
-static int SEEK_SETValue = SEEK_SET;
-static int SEEK_CURValue = SEEK_CUR;
-static int SEEK_ENDValue = SEEK_END;
-static int BUFSIZValue = BUFSIZ;
-static int FILENAME_MAXValue = FILENAME_MAX;
-static int _IOFBFValue = _IOFBF;
-static int _IOLBFValue = _IOLBF;
-static int _IONBFValue = _IONBF;
-static int L_tmpnamValue = L_tmpnam;
-static int GETS_MAXValue = 255;     /* arbitrary maximum size of a gets() file */
-
-static FILE *stdinValue;
-static FILE *stdoutValue;
-static FILE *stderrValue;
+static const int Stdio_ZeroValue = 0;
+static const int EOFValue = EOF;
+static const int SEEK_SETValue = SEEK_SET;
+static const int SEEK_CURValue = SEEK_CUR;
+static const int SEEK_ENDValue = SEEK_END;
+static const int BUFSIZValue = BUFSIZ;
+static const int FILENAME_MAXValue = FILENAME_MAX;
+static const int _IOFBFValue = _IOFBF;
+static const int _IOLBFValue = _IOLBF;
+static const int _IONBFValue = _IONBF;
+static const int L_tmpnamValue = L_tmpnam;
+static const int GETS_MAXValue = 255;     /* arbitrary maximum size of a gets() file */
 
 
 /* our own internal output stream which can output to FILE * or strings */
@@ -46,9 +42,9 @@ struct StdVararg
 void BasicIOInit(Picoc *pc)
 {
     pc->CStdOut = stdout;
-    stdinValue = stdin;
-    stdoutValue = stdout;
-    stderrValue = stderr;
+    pc->StdinValue = stdin;
+    pc->StdoutValue = stdout;
+    pc->StderrValue = stderr;
 }
 
 /* output a single character to either a FILE * or a string */
@@ -471,7 +467,12 @@ void StdioFseek(struct ParseState *Parser, struct Value *ReturnValue, struct Val
 
 void StdioPerror(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    perror(Param[0]->Val->Pointer);
+    const char *Message = Param[0]->Val->Pointer;
+    
+    if (Message != NULL && *Message != '\0')
+        fprintf(Parser->pc->StderrValue, "%s: %s\n", Message, strerror(errno));
+    else
+        fprintf(Parser->pc->StderrValue, "%s\n", strerror(errno));
 }
 
 void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
@@ -481,7 +482,7 @@ void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 
 void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = putchar(Param[0]->Val->Integer);
+    ReturnValue->Val->Integer = putc(Param[0]->Val->Integer, Parser->pc->StdoutValue);
 }
 
 void StdioSetbuf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
@@ -501,12 +502,15 @@ void StdioUngetc(struct ParseState *Parser, struct Value *ReturnValue, struct Va
 
 void StdioPuts(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = puts(Param[0]->Val->Pointer);
+    if (fputs(Param[0]->Val->Pointer, Parser->pc->StdoutValue) < 0)
+        ReturnValue->Val->Integer = EOF;
+    else
+        ReturnValue->Val->Integer = putc('\n', Parser->pc->StdoutValue);
 }
 
 void StdioGets(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Pointer = fgets(Param[0]->Val->Pointer, GETS_MAXValue, stdin);
+    ReturnValue->Val->Pointer = fgets(Param[0]->Val->Pointer, GETS_MAXValue, Parser->pc->StdinValue);
     if (ReturnValue->Val->Pointer != NULL)
     {
         char *EOLPos = strchr(Param[0]->Val->Pointer, '\n');
@@ -517,7 +521,7 @@ void StdioGets(struct ParseState *Parser, struct Value *ReturnValue, struct Valu
 
 void StdioGetchar(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs) 
 {
-    ReturnValue->Val->Integer = getchar();
+    ReturnValue->Val->Integer = getc(Parser->pc->StdinValue);
 }
 
 void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -526,12 +530,12 @@ void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue, struct Va
     
     PrintfArgs.Param = Param;
     PrintfArgs.NumArgs = NumArgs-1;
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0, Param[0]->Val->Pointer, &PrintfArgs);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioVprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
 }
 
 void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -572,7 +576,7 @@ void StdioScanf(struct ParseState *Parser, struct Value *ReturnValue, struct Val
     
     ScanfArgs.Param = Param;
     ScanfArgs.NumArgs = NumArgs-1;
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL, Param[0]->Val->Pointer, &ScanfArgs);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser, Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer, &ScanfArgs);
 }
 
 void StdioFscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -605,7 +609,7 @@ void StdioVsnprintf(struct ParseState *Parser, struct Value *ReturnValue, struct
 
 void StdioVscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser, Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
 }
 
 void StdioVfscanf(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -706,9 +710,9 @@ void StdioSetupFunc(Picoc *pc)
     VariableDefinePlatformVar(pc, NULL, "GETS_MAX", &pc->IntType, (union AnyValue *)&GETS_MAXValue, FALSE);
     
     /* define stdin, stdout and stderr */
-    VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType, (union AnyValue *)&stdinValue, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType, (union AnyValue *)&stdoutValue, FALSE);
-    VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType, (union AnyValue *)&stderrValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType, (union AnyValue *)&pc->StdinValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType, (union AnyValue *)&pc->StdoutValue, FALSE);
+    VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType, (union AnyValue *)&pc->StderrValue, FALSE);
 
     /* define NULL, TRUE and FALSE */
     if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
@@ -3,7 +3,7 @@
 
 #ifndef BUILTIN_MINI_STDLIB
 
-static int Stdlib_ZeroValue = 0;
+static const int Stdlib_ZeroValue = 0;
 
 #ifndef NO_FP
 void StdlibAtof(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
@@ -51,6 +51,9 @@ void PrintMallocTable(Picoc *pc)
 
 void AddPointerMallocTable(Picoc *pc, unsigned long address, unsigned long size)
 {
+    if (address == 0 || pc->TotalMallocs >= MAX_MALLOCS)
+        return;
+
     pc->MallocInfo[pc->TotalMallocs][0] = address;
     pc->MallocInfo[pc->TotalMallocs][1] = size;
     pc->TotalMallocs++;
@@ -71,6 +74,7 @@ void RemovePointerMallocTable(Picoc *pc, unsigned long address)
     while (i<pc->TotalMallocs - 1){
         pc->MallocInfo[i][0] = pc->MallocInfo[i+1][0];
         pc->MallocInfo[i][1] = pc->MallocInfo[i+1][1];
+        i++;
     }
     pc->TotalMallocs--;
     PrintMallocTable(pc);
@@ -89,16 +93,56 @@ void StdlibCalloc(struct ParseState *Parser, struct Value *ReturnValue, struct V
     AddPointerMallocTable(Parser->pc, (unsigned long)((void *)ReturnValue->Val->Pointer), Param[0]->Val->Integer*Param[1]->Val->Integer);
 }
 
+unsigned long SizeMallocTable(Picoc *pc, unsigned long address)
+{
+    int i = 0;
+    for(i=0; i<pc->TotalMallocs; i++){
+        if(pc->MallocInfo[i][0] == address)
+            return pc->MallocInfo[i][1];
+    }
+
+    return 0;
+}
+
 void StdlibRealloc(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = realloc(Param[0]->Val->Pointer, Param[1]->Val->Integer);
-    /* TODO: Add to the malloc table */
+    void *Block = Param[0]->Val->Pointer;
+    unsigned long Size = Param[1]->Val->Integer;
+    unsigned long Address;
+
+#ifdef USE_MALLOC_HEAP
+    if (Block != NULL && PicocResetPointKeeps(Parser->pc, Block))
+    {
+        /* a reset needs the old block where it is, so move to a new one */
+        unsigned long OldSize = SizeMallocTable(Parser->pc, (unsigned long)Block);
+
+        ReturnValue->Val->Pointer = malloc(Size);
+        if (ReturnValue->Val->Pointer != NULL)
+            memcpy(ReturnValue->Val->Pointer, Block, OldSize < Size ? OldSize : Size);
+
+        AddPointerMallocTable(Parser->pc, (unsigned long)ReturnValue->Val->Pointer, Size);
+        return;
+    }
+#endif
+
+    /* the old block's address is only kept to find it in the malloc table */
+    Address = (unsigned long)Block;
+    ReturnValue->Val->Pointer = realloc(Block, Size);
+    if (Address != 0 && (ReturnValue->Val->Pointer != NULL || Size == 0))
+        RemovePointerMallocTable(Parser->pc, Address);
+
+    AddPointerMallocTable(Parser->pc, (unsigned long)ReturnValue->Val->Pointer, Size);
 }
 
 
 void StdlibFree(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
     /*printf("########## Free called\n");*/
+#ifdef USE_MALLOC_HEAP
+    /* blocks from before the reset point are kept for the next reset */
+    if (PicocResetPointKeeps(Parser->pc, Param[0]->Val->Pointer))
+        return;
+#endif
     free(Param[0]->Val->Pointer);
     RemovePointerMallocTable(Parser->pc, (unsigned long)((void *)(Param[0]->Val->Pointer)));
     PrintMallocTable(Parser->pc);
@@ -3,7 +3,7 @@
 
 #ifndef BUILTIN_MINI_STDLIB
 
-static int String_ZeroValue = 0;
+static const int String_ZeroValue = 0;
 
 void StringStrcpy(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
@@ -119,7 +119,12 @@ void StringStrstr(struct ParseState *Parser, struct Value *ReturnValue, struct V
 
 void StringStrtok(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = strtok(Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    /* keep strtok()'s place per interpreter rather than in the C library's own static */
+#ifndef WIN32
+    ReturnValue->Val->Pointer = strtok_r(Param[0]->Val->Pointer, Param[1]->Val->Pointer, &Parser->pc->StrtokState);
+#else
+    ReturnValue->Val->Pointer = strtok_s(Param[0]->Val->Pointer, Param[1]->Val->Pointer, &Parser->pc->StrtokState);
+#endif
 }
 
 void StringStrxfrm(struct ParseState *Parser, struct Value *ReturnValue, struct Value **Param, int NumArgs)
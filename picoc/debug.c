@@ -1,126 +1,198 @@
-/* picoc interactive debugger */
-
-#ifndef NO_DEBUGGER
-
-#include "interpreter.h"
-
-#define BREAKPOINT_HASH(p) ( ((unsigned long)(p)->FileName) ^ (((p)->Line << 16) | ((p)->CharacterPos << 16)) )
-
-/* initialise the debugger by clearing the breakpoint table */
-void DebugInit(Picoc *pc)
-{
-    TableInitTable(&pc->BreakpointTable, &pc->BreakpointHashTable[0], BREAKPOINT_TABLE_SIZE, TRUE);
-    pc->BreakpointCount = 0;
-}
-
-/* free the contents of the breakpoint table */
-void DebugCleanup(Picoc *pc)
-{
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-    int Count;
-    
-    for (Count = 0; Count < pc->BreakpointTable.Size; Count++)
-    {
-        for (Entry = pc->BreakpointHashTable[Count]; Entry != NULL; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
-        }
-    }
-}
-
-/* search the table for a breakpoint */
-static struct TableEntry *DebugTableSearchBreakpoint(struct ParseState *Parser, int *AddAt)
-{
-    struct TableEntry *Entry;
-    Picoc *pc = Parser->pc;
-    int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
-    
-    for (Entry = pc->BreakpointHashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
-    {
-        if (Entry->p.b.FileName == Parser->FileName && Entry->p.b.Line == Parser->Line && Entry->p.b.CharacterPos == Parser->CharacterPos)
-            return Entry;   /* found */
-    }
-    
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return NULL;
-}
-
-/* set a breakpoint in the table */
-void DebugSetBreakpoint(struct ParseState *Parser)
-{
-    int AddAt;
-    struct TableEntry *FoundEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
-    Picoc *pc = Parser->pc;
-    
-    if (FoundEntry == NULL)
-    {   
-        /* add it to the table */
-        struct TableEntry *NewEntry = HeapAllocMem(pc, sizeof(struct TableEntry));
-        if (NewEntry == NULL)
-            ProgramFailNoParser(pc, "out of memory");
-            
-        NewEntry->p.b.FileName = Parser->FileName;
-        NewEntry->p.b.Line = Parser->Line;
-        NewEntry->p.b.CharacterPos = Parser->CharacterPos;
-        NewEntry->Next = pc->BreakpointHashTable[AddAt];
-        pc->BreakpointHashTable[AddAt] = NewEntry;
-        pc->BreakpointCount++;
-    }
-}
-
-/* delete a breakpoint from the hash table */
-int DebugClearBreakpoint(struct ParseState *Parser)
-{
-    struct TableEntry **EntryPtr;
-    Picoc *pc = Parser->pc;
-    int HashValue = BREAKPOINT_HASH(Parser) % pc->BreakpointTable.Size;
-    
-    for (EntryPtr = &pc->BreakpointHashTable[HashValue]; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->Next)
-    {
-        struct TableEntry *DeleteEntry = *EntryPtr;
-        if (DeleteEntry->p.b.FileName == Parser->FileName && DeleteEntry->p.b.Line == Parser->Line && DeleteEntry->p.b.CharacterPos == Parser->CharacterPos)
-        {
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
-            pc->BreakpointCount--;
-
-            return TRUE;
-        }
-    }
-
-    return FALSE;
-}
-
-/* before we run a statement, check if there's anything we have to do with the debugger here */
-void DebugCheckStatement(struct ParseState *Parser)
-{
-    int DoBreak = FALSE;
-    int AddAt;
-    Picoc *pc = Parser->pc;
-    
-    /* has the user manually pressed break? */
-    if (pc->DebugManualBreak)
-    {
-        PlatformPrintf(pc->CStdOut, "break\n");
-        DoBreak = TRUE;
-        pc->DebugManualBreak = FALSE;
-    }
-    
-    /* is this a breakpoint location? */
-    if (Parser->pc->BreakpointCount != 0 && DebugTableSearchBreakpoint(Parser, &AddAt) != NULL)
-        DoBreak = TRUE;
-    
-    /* handle a break */
-    if (DoBreak)
-    {
-        PlatformPrintf(pc->CStdOut, "Handling a break\n");
-        PicocParseInteractiveNoStartPrompt(pc, FALSE);
-    }
-}
-
-void DebugStep()
-{
-}
-#endif /* !NO_DEBUGGER */
+/* picoc interactive debugger */
+
+#ifndef NO_DEBUGGER
+
+#include "interpreter.h"
+
+/* grow the breakpoint table when Count / Size would exceed 3/4 */
+#define BREAKPOINT_MAX_LOAD(Count, Size) ((Count) * 4 > (Size) * 3)
+
+/* initialise the debugger by clearing the breakpoint table */
+void DebugInit(Picoc *pc)
+{
+    TableInitTable(&pc->BreakpointTable, &pc->BreakpointHashTable[0], BREAKPOINT_TABLE_SIZE, TRUE);
+    pc->BreakpointCount = 0;
+}
+
+/* free the contents of the breakpoint table */
+void DebugCleanup(Picoc *pc)
+{
+    int Count;
+    
+    for (Count = 0; Count < pc->BreakpointTable.Size; Count++)
+    {
+        if (pc->BreakpointTable.HashTable[Count] != NULL)
+            HeapFreeMem(pc, pc->BreakpointTable.HashTable[Count]);
+    }
+    
+    TableFreeHashTable(pc, &pc->BreakpointTable);
+}
+
+/* hash a breakpoint's position. the breakpoint table is open-addressed like
+ * the other tables, but keyed on a position rather than a shared string */
+static unsigned int DebugBreakpointHash(const char *FileName, int Line, int CharacterPos)
+{
+    unsigned long Hash = (((unsigned long)FileName) >> 3) ^ ((unsigned long)Line << 12) ^ (unsigned long)CharacterPos;
+    
+    Hash ^= Hash >> 16;
+    Hash *= 0x45d9f3bUL;
+    Hash ^= Hash >> 16;
+    
+    return (unsigned int)Hash;
+}
+
+/* search the table for a breakpoint */
+static struct TableEntry *DebugTableSearchBreakpoint(struct ParseState *Parser, int *AddAt)
+{
+    struct TableEntry *Entry;
+    Picoc *pc = Parser->pc;
+    unsigned int Mask = pc->BreakpointTable.Size - 1;
+    unsigned int Slot = DebugBreakpointHash(Parser->FileName, Parser->Line, Parser->CharacterPos) & Mask;
+    
+    while ((Entry = pc->BreakpointTable.HashTable[Slot]) != NULL)
+    {
+        if (Entry->p.b.FileName == Parser->FileName && Entry->p.b.Line == Parser->Line && Entry->p.b.CharacterPos == Parser->CharacterPos)
+            return Entry;   /* found */
+        
+        Slot = (Slot + 1) & Mask;
+    }
+    
+    *AddAt = Slot;    /* didn't find it - this is the first free slot */
+    return NULL;
+}
+
+/* double the size of the breakpoint table and re-insert all the breakpoints */
+static void DebugGrowBreakpoints(Picoc *pc)
+{
+    struct Table *Tbl = &pc->BreakpointTable;
+    int NewSize = Tbl->Size * 2;
+    struct TableEntry **NewHashTable = HeapAllocMem(pc, sizeof(struct TableEntry *) * NewSize);
+    struct TableEntry *Entry;
+    unsigned int Slot;
+    int Count;
+    
+    if (NewHashTable == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+    
+    for (Count = 0; Count < Tbl->Size; Count++)
+    {
+        Entry = Tbl->HashTable[Count];
+        if (Entry == NULL)
+            continue;
+        
+        Slot = DebugBreakpointHash(Entry->p.b.FileName, Entry->p.b.Line, Entry->p.b.CharacterPos) & (NewSize - 1);
+        while (NewHashTable[Slot] != NULL)
+            Slot = (Slot + 1) & (NewSize - 1);
+        
+        NewHashTable[Slot] = Entry;
+    }
+    
+    if (Tbl->HashTableOnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+    
+    Tbl->HashTable = NewHashTable;
+    Tbl->HashTableOnHeap = TRUE;
+    Tbl->Size = NewSize;
+}
+
+/* set a breakpoint in the table */
+void DebugSetBreakpoint(struct ParseState *Parser)
+{
+    int AddAt;
+    struct TableEntry *FoundEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
+    Picoc *pc = Parser->pc;
+    
+    if (FoundEntry == NULL)
+    {   
+        /* add it to the table */
+        struct TableEntry *NewEntry = HeapAllocMem(pc, sizeof(struct TableEntry));
+        if (NewEntry == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+            
+        NewEntry->p.b.FileName = Parser->FileName;
+        NewEntry->p.b.Line = Parser->Line;
+        NewEntry->p.b.CharacterPos = Parser->CharacterPos;
+        
+        if (BREAKPOINT_MAX_LOAD(pc->BreakpointCount + 1, pc->BreakpointTable.Size))
+        {
+            DebugGrowBreakpoints(pc);
+            DebugTableSearchBreakpoint(Parser, &AddAt);
+        }
+        
+        pc->BreakpointTable.HashTable[AddAt] = NewEntry;
+        pc->BreakpointCount++;
+    }
+}
+
+/* delete a breakpoint from the hash table. the following entries in the probe
+ * sequence are shifted back so we never need tombstones */
+int DebugClearBreakpoint(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct Table *Tbl = &pc->BreakpointTable;
+    unsigned int Mask = Tbl->Size - 1;
+    unsigned int NextSlot;
+    unsigned int HomeSlot;
+    struct TableEntry *DeleteEntry;
+    struct TableEntry *Entry;
+    unsigned int Slot;
+    int AddAt;
+    
+    DeleteEntry = DebugTableSearchBreakpoint(Parser, &AddAt);
+    if (DeleteEntry == NULL)
+        return FALSE;
+    
+    Slot = DebugBreakpointHash(Parser->FileName, Parser->Line, Parser->CharacterPos) & Mask;
+    while (Tbl->HashTable[Slot] != DeleteEntry)
+        Slot = (Slot + 1) & Mask;
+    
+    HeapFreeMem(pc, DeleteEntry);
+    Tbl->HashTable[Slot] = NULL;
+    pc->BreakpointCount--;
+    
+    for (NextSlot = (Slot + 1) & Mask; (Entry = Tbl->HashTable[NextSlot]) != NULL; NextSlot = (NextSlot + 1) & Mask)
+    {
+        /* move the entry back if its home slot isn't cyclically in (Slot, NextSlot] */
+        HomeSlot = DebugBreakpointHash(Entry->p.b.FileName, Entry->p.b.Line, Entry->p.b.CharacterPos) & Mask;
+        if (((NextSlot - HomeSlot) & Mask) >= ((NextSlot - Slot) & Mask))
+        {
+            Tbl->HashTable[Slot] = Entry;
+            Tbl->HashTable[NextSlot] = NULL;
+            Slot = NextSlot;
+        }
+    }
+
+    return TRUE;
+}
+
+/* before we run a statement, check if there's anything we have to do with the debugger here */
+void DebugCheckStatement(struct ParseState *Parser)
+{
+    int DoBreak = FALSE;
+    int AddAt;
+    Picoc *pc = Parser->pc;
+    
+    /* has the user manually pressed break? */
+    if (pc->DebugManualBreak)
+    {
+        PlatformPrintf(pc->CStdOut, "break\n");
+        DoBreak = TRUE;
+        pc->DebugManualBreak = FALSE;
+    }
+    
+    /* is this a breakpoint location? */
+    if (Parser->pc->BreakpointCount != 0 && DebugTableSearchBreakpoint(Parser, &AddAt) != NULL)
+        DoBreak = TRUE;
+    
+    /* handle a break */
+    if (DoBreak)
+    {
+        PlatformPrintf(pc->CStdOut, "Handling a break\n");
+        PicocParseInteractiveNoStartPrompt(pc, FALSE);
+    }
+}
+
+void DebugStep()
+{
+}
+#endif /* !NO_DEBUGGER */
@@ -14,6 +14,13 @@
 
 #define DEEP_PRECEDENCE (BRACKET_PRECEDENCE*1000)
 
+/* types which can be pushed on the expression stack as immediates */
+#ifndef NO_FP
+#define IS_SCALAR_TYPE(t) (IS_INTEGER_NUMERIC_TYPE(t) || (t)->Base == TypeFP || (t)->Base == TypePointer)
+#else
+#define IS_SCALAR_TYPE(t) (IS_INTEGER_NUMERIC_TYPE(t) || (t)->Base == TypePointer)
+#endif
+
 #ifdef DEBUG_EXPRESSIONS
 #define debugf printf
 #else
@@ -39,8 +46,14 @@ struct ExpressionStack
     enum LexToken Op;                   /* the operator */
     short unsigned int Precedence;      /* the operator precedence of this node */
     unsigned char Order;                /* the evaluation order of this operator */
+    unsigned char OutOfBounds;          /* an array element outside its array - see ExpressionCheckBounds() */
 };
 
+/* where an array element is compared to the array it's in */
+#define ELEMENT_IN_BOUNDS 0
+#define ELEMENT_ONE_PAST_END 1              /* its address can be taken */
+#define ELEMENT_OUT_OF_BOUNDS 2             /* only its size can be taken */
+
 /* operator precedence definitions */
 struct OpPrecedence
 {
@@ -51,7 +64,7 @@ struct OpPrecedence
 };
 
 /* NOTE: the order of this array must correspond exactly to the order of these tokens in enum LexToken */
-static struct OpPrecedence OperatorPrecedence[] =
+static const struct OpPrecedence OperatorPrecedence[] =
 {
     /* TokenNone, */ { 0, 0, 0, "none" },
     /* TokenComma, */ { 0, 0, 0, "," },
@@ -282,9 +295,13 @@ double ExpressionAssignFP(struct ParseState *Parser, struct Value *DestValue, do
 /* push a node on to the expression stack */
 void ExpressionStackPushValueNode(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *ValueLoc)
 {
-    struct ExpressionStack *StackNode = VariableAlloc(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE);
+    struct ExpressionStack *StackNode = VariableAllocUninitialised(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE);
     StackNode->Next = *StackTop;
     StackNode->Val = ValueLoc;
+    StackNode->Op = TokenNone;
+    StackNode->Precedence = 0;
+    StackNode->Order = OrderNone;
+    StackNode->OutOfBounds = ELEMENT_IN_BOUNDS;
     *StackTop = StackNode;
 #ifdef FANCY_ERROR_MESSAGES
     StackNode->Line = Parser->Line;
@@ -295,10 +312,88 @@ void ExpressionStackPushValueNode(struct ParseState *Parser, struct ExpressionSt
 #endif
 }
 
+/* push a value whose header, data and stack node are carved out in a single 
+ * stack bump. every field is written directly so nothing needs to be cleared 
+ * first. when this is pushing the result of an operator the operands have 
+ * normally just been popped so this reuses their space. the layout is the same 
+ * as a normal push so it's popped the same way */
+static struct Value *ExpressionPushValueFast(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *Typ, int DataSize)
+{
+    Picoc *pc = Parser->pc;
+    struct Value *ValueLoc = (struct Value *)pc->HeapStackTop;
+    struct ExpressionStack *StackNode = (struct ExpressionStack *)((char *)ValueLoc + MEM_ALIGN(MEM_ALIGN(sizeof(struct Value)) + DataSize));
+    char *NewTop = (char *)StackNode + MEM_ALIGN(sizeof(struct ExpressionStack));
+    
+    if (NewTop > (char *)pc->HeapBottom)
+    {
+        /* it doesn't fit in what's left so let the stack allocator find room */
+        int Size = NewTop - (char *)ValueLoc;
+        
+        ValueLoc = HeapAllocStackUninitialised(pc, Size);
+        if (ValueLoc == NULL)
+            ProgramFail(Parser, "stack overflow");
+            
+        StackNode = (struct ExpressionStack *)((char *)ValueLoc + (Size - MEM_ALIGN(sizeof(struct ExpressionStack))));
+        NewTop = (char *)ValueLoc + Size;
+    }
+    
+    pc->HeapStackTop = (void *)NewTop;
+    ValueLoc->Typ = Typ;
+    ValueLoc->Val = (union AnyValue *)((char *)ValueLoc + MEM_ALIGN(sizeof(struct Value)));
+    ValueLoc->LValueFrom = NULL;
+    ValueLoc->ValOnHeap = FALSE;
+    ValueLoc->ValOnStack = TRUE;
+    ValueLoc->AnyValOnHeap = FALSE;
+    ValueLoc->IsLValue = FALSE;
+    ValueLoc->IsConstant = FALSE;
+    ValueLoc->ScopeID = Parser->ScopeID;
+    ValueLoc->OutOfScope = FALSE;
+    
+    StackNode->Next = *StackTop;
+    StackNode->Val = ValueLoc;
+    StackNode->Op = TokenNone;
+    StackNode->Precedence = 0;
+    StackNode->Order = OrderNone;
+    StackNode->OutOfBounds = ELEMENT_IN_BOUNDS;
+    *StackTop = StackNode;
+#ifdef DEBUG_EXPRESSIONS
+    ExpressionStackShow(Parser->pc, *StackTop);
+#endif
+    
+    return ValueLoc;
+}
+
+/* push a scalar temporary. scalars are the bulk of what goes through the 
+ * expression stack so they get this immediate form rather than going through
+ * the general value allocation functions */
+static union AnyValue *ExpressionPushScalar(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *Typ, int DataSize)
+{
+    return ExpressionPushValueFast(Parser, StackTop, Typ, DataSize)->Val;
+}
+
+/* push a value which refers to existing data, such as a struct member or an array element */
+static void ExpressionPushExistingData(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *Typ, union AnyValue *Data, int IsLValue, struct Value *LValueFrom)
+{
+    struct Value *ValueLoc = ExpressionPushValueFast(Parser, StackTop, Typ, 0);
+    ValueLoc->Val = Data;
+    ValueLoc->ValOnStack = FALSE;
+    ValueLoc->IsLValue = IsLValue;
+    ValueLoc->LValueFrom = LValueFrom;
+}
+
 /* push a blank value on to the expression stack by type */
 struct Value *ExpressionStackPushValueByType(struct ParseState *Parser, struct ExpressionStack **StackTop, struct ValueType *PushType)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, PushType, FALSE, NULL, FALSE);
+    struct Value *ValueLoc;
+    
+    if (IS_SCALAR_TYPE(PushType))
+    {
+        union AnyValue *Data = ExpressionPushScalar(Parser, StackTop, PushType, TypeSize(PushType, 0, FALSE));
+        memset((void *)Data, '\0', TypeSize(PushType, 0, FALSE));
+        return (*StackTop)->Val;
+    }
+    
+    ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, PushType, FALSE, NULL, FALSE);
     ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
     
     return ValueLoc;
@@ -307,7 +402,27 @@ struct Value *ExpressionStackPushValueByType(struct ParseState *Parser, struct E
 /* push a value on to the expression stack */
 void ExpressionStackPushValue(struct ParseState *Parser, struct ExpressionStack **StackTop, struct Value *PushValue)
 {
-    struct Value *ValueLoc = VariableAllocValueAndCopy(Parser->pc, Parser, PushValue, FALSE);
+    struct Value *ValueLoc;
+    
+    if (IS_SCALAR_TYPE(PushValue->Typ))
+    {
+        /* copy it as an immediate. the source may overlap where the copy goes
+         * if it was just popped so take a copy of the data first */
+        union AnyValue Data;
+        int DataSize = TypeSize(PushValue->Typ, 0, FALSE);
+        int IsLValue = PushValue->IsLValue;
+        struct Value *LValueFrom = PushValue->LValueFrom;
+        
+        memset((void *)&Data, '\0', DataSize);
+        memcpy((void *)&Data, (void *)PushValue->Val, TypeSizeValue(PushValue, TRUE));
+        memcpy((void *)ExpressionPushScalar(Parser, StackTop, PushValue->Typ, DataSize), (void *)&Data, DataSize);
+        ValueLoc = (*StackTop)->Val;
+        ValueLoc->IsLValue = IsLValue;
+        ValueLoc->LValueFrom = LValueFrom;
+        return;
+    }
+    
+    ValueLoc = VariableAllocValueAndCopy(Parser->pc, Parser, PushValue, FALSE);
     ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
 }
 
@@ -335,17 +450,15 @@ void ExpressionStackPushDereference(struct ParseState *Parser, struct Expression
 
 void ExpressionPushInt(struct ParseState *Parser, struct ExpressionStack **StackTop, long IntValue)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->IntType, FALSE, NULL, FALSE);
-    ValueLoc->Val->Integer = IntValue;
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
+    union AnyValue *Result = ExpressionPushScalar(Parser, StackTop, &Parser->pc->IntType, sizeof(ALIGN_TYPE));
+    Result->Pointer = NULL;     /* clear the extra room for type extension */
+    Result->Integer = IntValue;
 }
 
 #ifndef NO_FP
 void ExpressionPushFP(struct ParseState *Parser, struct ExpressionStack **StackTop, double FPValue)
 {
-    struct Value *ValueLoc = VariableAllocValueFromType(Parser->pc, Parser, &Parser->pc->FPType, FALSE, NULL, FALSE);
-    ValueLoc->Val->FP = FPValue;
-    ExpressionStackPushValueNode(Parser, StackTop, ValueLoc);
+    ExpressionPushScalar(Parser, StackTop, &Parser->pc->FPType, sizeof(double))->FP = FPValue;
 }
 #endif
 
@@ -546,6 +659,17 @@ void ExpressionPrefixOperator(struct ParseState *Parser, struct ExpressionStack
         
         default:
             /* an arithmetic operator */
+            if (TopValue->Typ == &Parser->pc->IntType && TopValue->IsLValue && (Op == TokenIncrement || Op == TokenDecrement))
+            {
+                /* fast path for the very common ++i and --i */
+                if (Op == TokenIncrement)
+                    TopValue->Val->Integer = (long)TopValue->Val->Integer + 1;
+                else
+                    TopValue->Val->Integer = (long)TopValue->Val->Integer - 1;
+                
+                ExpressionPushInt(Parser, StackTop, TopValue->Val->Integer);
+            }
+            else
 #ifndef NO_FP
             if (TopValue->Typ == &Parser->pc->FPType)
             {
@@ -618,6 +742,19 @@ void ExpressionPrefixOperator(struct ParseState *Parser, struct ExpressionStack
 void ExpressionPostfixOperator(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Op, struct Value *TopValue)
 {
     debugf("ExpressionPostfixOperator()\n");
+    if (TopValue->Typ == &Parser->pc->IntType && TopValue->IsLValue && (Op == TokenIncrement || Op == TokenDecrement))
+    {
+        /* fast path for the very common i++ and i-- */
+        int OrigInt = TopValue->Val->Integer;
+        
+        if (Op == TokenIncrement)
+            TopValue->Val->Integer = (long)OrigInt + 1;
+        else
+            TopValue->Val->Integer = (long)OrigInt - 1;
+        
+        ExpressionPushInt(Parser, StackTop, OrigInt);
+    }
+    else
 #ifndef NO_FP
     if (TopValue->Typ == &Parser->pc->FPType)
     {
@@ -677,6 +814,149 @@ void ExpressionPostfixOperator(struct ParseState *Parser, struct ExpressionStack
         ProgramFail(Parser, "invalid operation");
 }
 
+/* see whether an array element is inside the array. the element can go past
+ * the end of its own row as long as it's still inside the variable the array
+ * is part of, so flat indexing across the rows of a multi-dimensional array
+ * works as it always has */
+static int ExpressionElementBounds(struct Value *ArrayValue, int ArrayIndex, char *Element)
+{
+    struct Value *Whole = ArrayValue->LValueFrom;
+    int ElementSize = ArrayValue->Typ->FromType->Sizeof;
+    int ArraySize = TypeSizeValue(ArrayValue, TRUE);
+    char *Start = (char *)ArrayValue->Val;
+    char *End = Start + ArraySize;
+    
+    if (Whole != NULL && Whole->Typ->Base == TypeArray && (char *)Whole->Val <= Start && End <= (char *)Whole->Val + TypeSizeValue(Whole, TRUE))
+    {
+        Start = (char *)Whole->Val;
+        End = Start + TypeSizeValue(Whole, TRUE);
+    }
+    
+    if (ArrayIndex >= 0 && Element >= Start && Element + ElementSize <= End)
+        return ELEMENT_IN_BOUNDS;
+    else if (ArrayIndex >= 0 && Element == End)
+        return ELEMENT_ONE_PAST_END;
+    else
+        return ELEMENT_OUT_OF_BOUNDS;
+}
+
+/* an array element outside its array can only be used by sizeof, or by '&' if
+ * it's one past the end. Op is what's using it, or TokenNone for anything which
+ * isn't an operator */
+static void ExpressionCheckBounds(struct ParseState *Parser, struct ExpressionStack *Node, enum LexToken Op)
+{
+    if (Node->OutOfBounds == ELEMENT_IN_BOUNDS || Op == TokenSizeof || (Op == TokenAmpersand && Node->OutOfBounds == ELEMENT_ONE_PAST_END))
+        return;
+    
+    ProgramFail(Parser, "array index is out of bounds");
+}
+
+/* infix arithmetic specialised for two int or two long operands. returns FALSE 
+ * if it's an operator we don't handle here so the general case can deal with it */
+static int ExpressionInfixFastInteger(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Op, struct Value *BottomValue, struct Value *TopValue)
+{
+    int IsLong = (BottomValue->Typ == &Parser->pc->LongType);
+    long BottomInt = IsLong ? BottomValue->Val->LongInteger : BottomValue->Val->Integer;
+    long TopInt = IsLong ? TopValue->Val->LongInteger : TopValue->Val->Integer;
+    long ResultInt;
+    
+    switch (Op)
+    {
+        case TokenEqual:                ExpressionPushInt(Parser, StackTop, BottomInt == TopInt); return TRUE;
+        case TokenNotEqual:             ExpressionPushInt(Parser, StackTop, BottomInt != TopInt); return TRUE;
+        case TokenLessThan:             ExpressionPushInt(Parser, StackTop, BottomInt < TopInt); return TRUE;
+        case TokenGreaterThan:          ExpressionPushInt(Parser, StackTop, BottomInt > TopInt); return TRUE;
+        case TokenLessEqual:            ExpressionPushInt(Parser, StackTop, BottomInt <= TopInt); return TRUE;
+        case TokenGreaterEqual:         ExpressionPushInt(Parser, StackTop, BottomInt >= TopInt); return TRUE;
+        case TokenLogicalOr:            ExpressionPushInt(Parser, StackTop, BottomInt || TopInt); return TRUE;
+        case TokenLogicalAnd:           ExpressionPushInt(Parser, StackTop, BottomInt && TopInt); return TRUE;
+        case TokenPlus:                 ResultInt = BottomInt + TopInt; break;
+        case TokenMinus:                ResultInt = BottomInt - TopInt; break;
+        case TokenAsterisk:             ResultInt = BottomInt * TopInt; break;
+        case TokenSlash:                ResultInt = BottomInt / TopInt; break;
+#ifndef NO_MODULUS
+        case TokenModulus:              ResultInt = BottomInt % TopInt; break;
+#endif
+        case TokenArithmeticOr:         ResultInt = BottomInt | TopInt; break;
+        case TokenArithmeticExor:       ResultInt = BottomInt ^ TopInt; break;
+        case TokenAmpersand:            ResultInt = BottomInt & TopInt; break;
+        case TokenShiftLeft:            ResultInt = BottomInt << TopInt; break;
+        case TokenShiftRight:           ResultInt = BottomInt >> TopInt; break;
+        
+        case TokenAssign: case TokenAddAssign: case TokenSubtractAssign: case TokenMultiplyAssign: case TokenDivideAssign:
+            if (!BottomValue->IsLValue)
+                return FALSE;
+            
+            switch (Op)
+            {
+                case TokenAssign:           ResultInt = TopInt; break;
+                case TokenAddAssign:        ResultInt = BottomInt + TopInt; break;
+                case TokenSubtractAssign:   ResultInt = BottomInt - TopInt; break;
+                case TokenMultiplyAssign:   ResultInt = BottomInt * TopInt; break;
+                default:                    ResultInt = BottomInt / TopInt; break;
+            }
+            
+            if (IsLong)
+                BottomValue->Val->LongInteger = ResultInt;
+            else
+                BottomValue->Val->Integer = ResultInt;
+            break;
+        
+        default:
+            return FALSE;
+    }
+    
+    /* the result is an int, as it is in the general case */
+    ExpressionPushInt(Parser, StackTop, ResultInt);
+    return TRUE;
+}
+
+#ifndef NO_FP
+/* infix arithmetic specialised for two double operands */
+static int ExpressionInfixFastFP(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Op, struct Value *BottomValue, struct Value *TopValue)
+{
+    double BottomFP = BottomValue->Val->FP;
+    double TopFP = TopValue->Val->FP;
+    double ResultFP;
+    
+    switch (Op)
+    {
+        case TokenEqual:                ExpressionPushInt(Parser, StackTop, BottomFP == TopFP); return TRUE;
+        case TokenNotEqual:             ExpressionPushInt(Parser, StackTop, BottomFP != TopFP); return TRUE;
+        case TokenLessThan:             ExpressionPushInt(Parser, StackTop, BottomFP < TopFP); return TRUE;
+        case TokenGreaterThan:          ExpressionPushInt(Parser, StackTop, BottomFP > TopFP); return TRUE;
+        case TokenLessEqual:            ExpressionPushInt(Parser, StackTop, BottomFP <= TopFP); return TRUE;
+        case TokenGreaterEqual:         ExpressionPushInt(Parser, StackTop, BottomFP >= TopFP); return TRUE;
+        case TokenPlus:                 ResultFP = BottomFP + TopFP; break;
+        case TokenMinus:                ResultFP = BottomFP - TopFP; break;
+        case TokenAsterisk:             ResultFP = BottomFP * TopFP; break;
+        case TokenSlash:                ResultFP = BottomFP / TopFP; break;
+        
+        case TokenAssign: case TokenAddAssign: case TokenSubtractAssign: case TokenMultiplyAssign: case TokenDivideAssign:
+            if (!BottomValue->IsLValue)
+                return FALSE;
+            
+            switch (Op)
+            {
+                case TokenAssign:           ResultFP = TopFP; break;
+                case TokenAddAssign:        ResultFP = BottomFP + TopFP; break;
+                case TokenSubtractAssign:   ResultFP = BottomFP - TopFP; break;
+                case TokenMultiplyAssign:   ResultFP = BottomFP * TopFP; break;
+                default:                    ResultFP = BottomFP / TopFP; break;
+            }
+            
+            BottomValue->Val->FP = ResultFP;
+            break;
+        
+        default:
+            return FALSE;
+    }
+    
+    ExpressionPushFP(Parser, StackTop, ResultFP);
+    return TRUE;
+}
+#endif
+
 /* evaluate an infix operator */
 void ExpressionInfixOperator(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Op, struct Value *BottomValue, struct Value *TopValue)
 {
@@ -687,27 +967,47 @@ void ExpressionInfixOperator(struct ParseState *Parser, struct ExpressionStack *
     debugf("ExpressionInfixOperator()\n");
     if (BottomValue == NULL || TopValue == NULL)
         ProgramFail(Parser, "invalid expression");
+    
+    /* try the fast paths for the common cases first */
+    if (BottomValue->Typ == TopValue->Typ)
+    {
+        if ((TopValue->Typ == &Parser->pc->IntType || TopValue->Typ == &Parser->pc->LongType) && ExpressionInfixFastInteger(Parser, StackTop, Op, BottomValue, TopValue))
+            return;
+#ifndef NO_FP
+        if (TopValue->Typ == &Parser->pc->FPType && ExpressionInfixFastFP(Parser, StackTop, Op, BottomValue, TopValue))
+            return;
+#endif
+    }
         
     if (Op == TokenLeftSquareBracket)
     { 
         /* array index */
-        int ArrayIndex;
-        struct Value *Result = NULL;
+        int ArrayIndex = 0;
+        union AnyValue *Element = NULL;
+        int OutOfBounds = ELEMENT_IN_BOUNDS;
         
-        if (!IS_NUMERIC_COERCIBLE(TopValue))
+        if (TopValue->Typ == &Parser->pc->IntType)
+            ArrayIndex = TopValue->Val->Integer;
+        else if (IS_NUMERIC_COERCIBLE(TopValue))
+            ArrayIndex = ExpressionCoerceInteger(TopValue);
+        else
             ProgramFail(Parser, "array index must be an integer");
-        
-        ArrayIndex = ExpressionCoerceInteger(TopValue);
 
-        /* make the array element result */
+        /* find the element. the result refers straight to the element's data */
         switch (BottomValue->Typ->Base)
         {
-            case TypeArray:   Result = VariableAllocValueFromExistingData(Parser, BottomValue->Typ->FromType, (union AnyValue *)(&BottomValue->Val->ArrayMem[0] + TypeSize(BottomValue->Typ, ArrayIndex, TRUE)), BottomValue->IsLValue, BottomValue->LValueFrom); break;
-            case TypePointer: Result = VariableAllocValueFromExistingData(Parser, BottomValue->Typ->FromType, (union AnyValue *)((char *)BottomValue->Val->Pointer + TypeSize(BottomValue->Typ->FromType, 0, TRUE) * ArrayIndex), BottomValue->IsLValue, BottomValue->LValueFrom); break;
+            case TypeArray:
+                Element = (union AnyValue *)(&BottomValue->Val->ArrayMem[0] + TypeSize(BottomValue->Typ, ArrayIndex, TRUE)); 
+                if (BottomValue->Typ->ArraySize != 0)
+                    OutOfBounds = ExpressionElementBounds(BottomValue, ArrayIndex, (char *)Element);
+                break;
+            
+            case TypePointer: Element = (union AnyValue *)((char *)BottomValue->Val->Pointer + TypeSize(BottomValue->Typ->FromType, 0, TRUE) * ArrayIndex); break;
             default:          ProgramFail(Parser, "this %t is not an array", BottomValue->Typ);
         }
         
-        ExpressionStackPushValueNode(Parser, StackTop, Result);
+        ExpressionPushExistingData(Parser, StackTop, BottomValue->Typ->FromType, Element, BottomValue->IsLValue, BottomValue->LValueFrom);
+        (*StackTop)->OutOfBounds = OutOfBounds;
     }
     else if (Op == TokenQuestionMark)
         ExpressionQuestionMarkOperator(Parser, StackTop, TopValue, BottomValue);
@@ -922,6 +1222,8 @@ void ExpressionStackCollapse(struct ParseState *Parser, struct ExpressionStack *
                     /* prefix evaluation */
                     debugf("prefix evaluation\n");
                     TopValue = TopStackNode->Val;
+                    if (TopStackNode->OutOfBounds)
+                        ExpressionCheckBounds(Parser, TopStackNode, TopOperatorNode->Op);
                     
                     /* pop the value and then the prefix operator - assume they'll still be there until we're done */
                     HeapPopStack(Parser->pc, NULL, sizeof(struct ExpressionStack) + sizeof(struct Value) + TypeStackSizeValue(TopValue));
@@ -945,6 +1247,8 @@ void ExpressionStackCollapse(struct ParseState *Parser, struct ExpressionStack *
                     /* postfix evaluation */
                     debugf("postfix evaluation\n");
                     TopValue = TopStackNode->Next->Val;
+                    if (TopStackNode->Next->OutOfBounds)
+                        ExpressionCheckBounds(Parser, TopStackNode->Next, TokenNone);
                     
                     /* pop the postfix operator and then the value - assume they'll still be there until we're done */
                     HeapPopStack(Parser->pc, NULL, sizeof(struct ExpressionStack));
@@ -971,6 +1275,11 @@ void ExpressionStackCollapse(struct ParseState *Parser, struct ExpressionStack *
                     if (TopValue != NULL)
                     {
                         BottomValue = TopOperatorNode->Next->Val;
+                        if (TopStackNode->OutOfBounds || TopOperatorNode->Next->OutOfBounds)
+                        {
+                            ExpressionCheckBounds(Parser, TopStackNode, TokenNone);
+                            ExpressionCheckBounds(Parser, TopOperatorNode->Next, TokenNone);
+                        }
                         
                         /* pop a value, the operator and another value - assume they'll still be there until we're done */
                         HeapPopStack(Parser->pc, NULL, sizeof(struct ExpressionStack) + sizeof(struct Value) + TypeStackSizeValue(TopValue));
@@ -1018,11 +1327,13 @@ void ExpressionStackCollapse(struct ParseState *Parser, struct ExpressionStack *
 /* push an operator on to the expression stack */
 void ExpressionStackPushOperator(struct ParseState *Parser, struct ExpressionStack **StackTop, enum OperatorOrder Order, enum LexToken Token, int Precedence)
 {
-    struct ExpressionStack *StackNode = VariableAlloc(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE);
+    struct ExpressionStack *StackNode = VariableAllocUninitialised(Parser->pc, Parser, sizeof(struct ExpressionStack), FALSE);
     StackNode->Next = *StackTop;
+    StackNode->Val = NULL;
     StackNode->Order = Order;
     StackNode->Op = Token;
     StackNode->Precedence = Precedence;
+    StackNode->OutOfBounds = ELEMENT_IN_BOUNDS;
     *StackTop = StackNode;
     debugf("ExpressionStackPushOperator()\n");
 #ifdef FANCY_ERROR_MESSAGES
@@ -1038,6 +1349,7 @@ void ExpressionStackPushOperator(struct ParseState *Parser, struct ExpressionSta
 void ExpressionGetStructElement(struct ParseState *Parser, struct ExpressionStack **StackTop, enum LexToken Token)
 {
     struct Value *Ident;
+    const unsigned char *MemberPos = Parser->Pos;
     
     /* get the identifier following the '.' or '->' */
     if (LexGetToken(Parser, &Ident, TRUE) != TokenIdentifier)
@@ -1050,26 +1362,39 @@ void ExpressionGetStructElement(struct ParseState *Parser, struct ExpressionStac
         struct Value *StructVal = ParamVal;
         struct ValueType *StructType = ParamVal->Typ;
         char *DerefDataLoc = (char *)ParamVal->Val;
-        struct Value *MemberValue = NULL;
-        struct Value *Result;
+        struct MemberCacheEntry *Cache = &Parser->pc->MemberCache[MEMBER_CACHE_HASH(MemberPos)];
+
+        if ((*StackTop)->OutOfBounds)
+            ExpressionCheckBounds(Parser, *StackTop, TokenNone);
 
         /* if we're doing '->' dereference the struct pointer first */
         if (Token == TokenArrow)
             DerefDataLoc = VariableDereferencePointer(Parser, ParamVal, &StructVal, NULL, &StructType, NULL);
         
-        if (StructType->Base != TypeStruct && StructType->Base != TypeUnion)
-            ProgramFail(Parser, "can't use '%s' on something that's not a struct or union %s : it's a %t", (Token == TokenDot) ? "." : "->", (Token == TokenArrow) ? "pointer" : "", ParamVal->Typ);
+        /* has this member reference already been resolved for this struct type? */
+        if (Cache->Pos != MemberPos || Cache->StructType != StructType || Cache->Identifier != Ident->Val->Identifier)
+        {
+            struct Value *MemberValue = NULL;
+            
+            if (StructType->Base != TypeStruct && StructType->Base != TypeUnion)
+                ProgramFail(Parser, "can't use '%s' on something that's not a struct or union %s : it's a %t", (Token == TokenDot) ? "." : "->", (Token == TokenArrow) ? "pointer" : "", ParamVal->Typ);
+            
+            if (StructType->Members == NULL || !TableGet(StructType->Members, Ident->Val->Identifier, &MemberValue, NULL, NULL, NULL))
+                ProgramFail(Parser, "doesn't have a member called '%s'", Ident->Val->Identifier);
             
-        if (!TableGet(StructType->Members, Ident->Val->Identifier, &MemberValue, NULL, NULL, NULL))
-            ProgramFail(Parser, "doesn't have a member called '%s'", Ident->Val->Identifier);
+            Cache->Pos = MemberPos;
+            Cache->StructType = StructType;
+            Cache->Identifier = Ident->Val->Identifier;
+            Cache->MemberType = MemberValue->Typ;
+            Cache->Offset = MemberValue->Val->Integer;
+        }
         
         /* pop the value - assume it'll still be there until we're done */
         HeapPopStack(Parser->pc, ParamVal, sizeof(struct ExpressionStack) + sizeof(struct Value) + TypeStackSizeValue(StructVal));
         *StackTop = (*StackTop)->Next;
         
         /* make the result value for this member only */
-        Result = VariableAllocValueFromExistingData(Parser, MemberValue->Typ, (void *)(DerefDataLoc + MemberValue->Val->Integer), TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL);
-        ExpressionStackPushValueNode(Parser, StackTop, Result);
+        ExpressionPushExistingData(Parser, StackTop, Cache->MemberType, (union AnyValue *)(DerefDataLoc + Cache->Offset), TRUE, (StructVal != NULL) ? StructVal->LValueFrom : NULL);
     }
 }
 
@@ -1288,7 +1613,23 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
 
             PrefixState = FALSE;
         }
-        else if ((int)Token > TokenCloseBracket && (int)Token <= TokenCharacterConstant)
+        else if (Token == TokenMacroParameter)
+        {
+            /* an argument of the macro we're expanding */
+            if (!PrefixState)
+                ProgramFail(Parser, "identifier not expected here");
+                
+            if (Parser->Mode == RunModeRun)
+                ExpressionStackPushLValue(Parser, &StackTop, Parser->MacroArgs[LexValue->Val->Integer], 0);
+            else
+                ExpressionPushInt(Parser, &StackTop, 0);
+                
+            if (Precedence <= IgnorePrecedence)
+                IgnorePrecedence = DEEP_PRECEDENCE;
+                
+            PrefixState = FALSE;
+        }
+        else if ((int)Token > TokenCloseBracket && (int)Token <= TokenFoldedConstant)
         { 
             /* it's a value of some sort, push it */
             if (!PrefixState)
@@ -1339,6 +1680,9 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
             if (StackTop->Order != OrderNone || StackTop->Next != NULL)
                 ProgramFail(Parser, "invalid expression");
                 
+            if (StackTop->OutOfBounds)
+                ExpressionCheckBounds(Parser, StackTop, TokenNone);
+                
             *Result = StackTop->Val;
             HeapPopStack(Parser->pc, StackTop, sizeof(struct ExpressionStack));
         }
@@ -1373,9 +1717,9 @@ void ExpressionParseMacroCall(struct ParseState *Parser, struct ExpressionStack
 #endif
         ReturnValue = (*StackTop)->Val;
         HeapPushStackFrame(Parser->pc);
-        ParamArray = HeapAllocStack(Parser->pc, sizeof(struct Value *) * MDef->NumParams);    
+        ParamArray = HeapAllocStackUninitialised(Parser->pc, sizeof(struct Value *) * MDef->NumParams);    
         if (ParamArray == NULL)
-            ProgramFail(Parser, "out of memory");
+            ProgramFail(Parser, "stack overflow");
     }
     else
         ExpressionPushInt(Parser, StackTop, 0);
@@ -1422,15 +1766,28 @@ void ExpressionParseMacroCall(struct ParseState *Parser, struct ExpressionStack
             ProgramFail(Parser, "'%s' is undefined", MacroName);
         
         ParserCopy(&MacroParser, &MDef->Body);
-        VariableStackFrameAdd(Parser, MacroName, 0);
-        Parser->pc->TopStackFrame->NumParams = ArgCount;
-        Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
-        for (Count = 0; Count < MDef->NumParams; Count++)
-            VariableDefine(Parser->pc, Parser, MDef->ParamName[Count], ParamArray[Count], NULL, TRUE);
+        if (MDef->IsTemplate)
+        {
+            /* the body refers to the arguments directly, give it writable copies of them */
+            for (Count = 0; Count < MDef->NumParams; Count++)
+                ParamArray[Count] = VariableAllocValueAndCopy(Parser->pc, Parser, ParamArray[Count], FALSE);
             
-        ExpressionParse(&MacroParser, &EvalValue);
-        ExpressionAssign(Parser, ReturnValue, EvalValue, TRUE, MacroName, 0, FALSE);
-        VariableStackFramePop(Parser);
+            MacroParser.MacroArgs = ParamArray;
+            ExpressionParse(&MacroParser, &EvalValue);
+            ExpressionAssign(Parser, ReturnValue, EvalValue, TRUE, MacroName, 0, FALSE);
+        }
+        else
+        {
+            VariableStackFrameAdd(Parser, MacroName, 0);
+            Parser->pc->TopStackFrame->NumParams = ArgCount;
+            Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
+            for (Count = 0; Count < MDef->NumParams; Count++)
+                VariableDefine(Parser->pc, Parser, MDef->ParamName[Count], ParamArray[Count], NULL, TRUE);
+                
+            ExpressionParse(&MacroParser, &EvalValue);
+            ExpressionAssign(Parser, ReturnValue, EvalValue, TRUE, MacroName, 0, FALSE);
+            VariableStackFramePop(Parser);
+        }
         HeapPopStackFrame(Parser->pc);
     }
 }
@@ -1464,9 +1821,9 @@ void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionSta
         ExpressionStackPushValueByType(Parser, StackTop, FuncValue->Val->FuncDef.ReturnType);
         ReturnValue = (*StackTop)->Val;
         HeapPushStackFrame(Parser->pc);
-        ParamArray = HeapAllocStack(Parser->pc, sizeof(struct Value *) * FuncValue->Val->FuncDef.NumParams);    
+        ParamArray = HeapAllocStackUninitialised(Parser->pc, sizeof(struct Value *) * FuncValue->Val->FuncDef.NumParams);    
         if (ParamArray == NULL)
-            ProgramFail(Parser, "out of memory");
+            ProgramFail(Parser, "stack overflow");
     }
     else
     {
@@ -1533,7 +1890,7 @@ void ExpressionParseFunctionCall(struct ParseState *Parser, struct ExpressionSta
             Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
 
             /* Function parameters should not go out of scope */
-            Parser->ScopeID = -1;
+            Parser->ScopeID = SCOPE_ID_NONE;
 
             for (Count = 0; Count < FuncValue->Val->FuncDef.NumParams; Count++)
                 VariableDefine(Parser->pc, Parser, FuncValue->Val->FuncDef.ParamName[Count], ParamArray[Count], NULL, TRUE);
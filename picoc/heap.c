@@ -5,16 +5,114 @@
 /* stack grows up from the bottom and heap grows down from the top of heap space */
 #include "interpreter.h"
 
+#ifndef USE_MALLOC_HEAP
+/* blocks in the built-in heap have a size tag at the start. the bottom bits of 
+ * the size say whether the block is in use and whether the block below it is 
+ * free. free blocks also have a copy of their size at the end so a block being 
+ * freed can find the free block below it and merge with it */
+#define HEAP_TAG_SIZE MEM_ALIGN(sizeof(unsigned int))
+#define HEAP_BLOCK_USED 1                           /* this block is allocated */
+#define HEAP_PREV_FREE 2                            /* the block just below this one is free */
+#define HEAP_FLAGS (HEAP_BLOCK_USED | HEAP_PREV_FREE)
+#define HEAP_BLOCK_SIZE(n) ((n)->Size & ~HEAP_FLAGS)
+#define HEAP_MIN_BLOCK MEM_ALIGN(sizeof(struct AllocNode) + HEAP_TAG_SIZE)
+#define HEAP_NEXT_BLOCK(n) ((struct AllocNode *)((char *)(n) + HEAP_BLOCK_SIZE(n)))
+#endif
+
 #ifdef DEBUG_HEAP
-void ShowBigList(Picoc *pc)
+void ShowHeapStats(Picoc *pc)
+{
+#ifndef USE_MALLOC_HEAP
+    struct HeapStats Stats;
+    
+    HeapGetStats(pc, &Stats);
+    printf("Heap: bottom=0x%lx top=0x%lx, %d in use, %d free in %d blocks, largest free %d\n", (long)pc->HeapBottom, (long)pc->HeapTop, Stats.InUse, Stats.FreeBytes, Stats.FreeBlocks, Stats.LargestFree);
+#endif
+}
+#endif
+
+#ifdef USE_STACK_SEGMENTS
+#define STACK_SEGMENT_DATA(s) ((char *)(s) + MEM_ALIGN(sizeof(struct StackSegment)))
+
+/* start a new stack segment with room for at least Size bytes. the segment 
+ * comes from the pool if there's a big enough one there. returns FALSE if the 
+ * stack would grow beyond its limit */
+static int HeapStackGrow(Picoc *pc, int Size)
 {
-    struct AllocNode *LPos;
+    struct StackSegment *Seg = pc->StackSegmentPool;
+    int SegSize = MEM_ALIGN(sizeof(struct StackSegment)) + MEM_ALIGN(Size);
     
-    printf("Heap: bottom=0x%lx 0x%lx-0x%lx, big freelist=", (long)pc->HeapBottom, (long)&(pc->HeapMemory)[0], (long)&(pc->HeapMemory)[HEAP_SIZE]);
-    for (LPos = pc->FreeListBig; LPos != NULL; LPos = LPos->NextFree)
-        printf("0x%lx:%d ", (long)LPos, LPos->Size);
+    if (SegSize < STACK_SEGMENT_SIZE)
+        SegSize = STACK_SEGMENT_SIZE;
     
-    printf("\n");
+    if (Seg != NULL && Seg->Size >= SegSize)
+    {
+        if (pc->StackSegmentBytes + Seg->Size > pc->StackMaxBytes)
+            return FALSE;
+            
+        pc->StackSegmentPool = Seg->Prev;
+    }
+    else
+    {
+        if (pc->StackSegmentBytes + SegSize > pc->StackMaxBytes)
+            return FALSE;
+            
+        Seg = malloc(SegSize);
+        if (Seg == NULL)
+            return FALSE;
+            
+        Seg->Size = SegSize;
+        Seg->End = (char *)Seg + SegSize;
+    }
+    
+#ifdef DEBUG_HEAP
+    printf("HeapStackGrow(%ld) new segment at 0x%lx\n", (unsigned long)Size, (unsigned long)Seg);
+#endif
+    Seg->Prev = pc->StackSegment;
+    Seg->PrevTop = pc->HeapStackTop;
+    pc->StackSegment = Seg;
+    pc->StackSegmentBytes += Seg->Size;
+    pc->HeapStackTop = STACK_SEGMENT_DATA(Seg);
+    pc->HeapBottom = Seg->End;
+    return TRUE;
+}
+
+/* go back to the segment below the current one, putting the current one in 
+ * the pool. its memory stays valid until the pool is trimmed so values which 
+ * have just been popped from it can still be read */
+static void HeapStackRelease(Picoc *pc)
+{
+    struct StackSegment *Seg = pc->StackSegment;
+    
+    pc->HeapStackTop = Seg->PrevTop;
+    pc->StackSegment = Seg->Prev;
+    pc->StackSegmentBytes -= Seg->Size;
+    pc->HeapBottom = pc->StackSegment->End;
+    Seg->Prev = pc->StackSegmentPool;
+    pc->StackSegmentPool = Seg;
+}
+
+/* free oversized segments and any beyond the few we keep for reuse */
+static void HeapStackTrimPool(Picoc *pc)
+{
+    struct StackSegment **SegPtr = &pc->StackSegmentPool;
+    int Kept = 0;
+    
+    while (*SegPtr != NULL)
+    {
+        struct StackSegment *Seg = *SegPtr;
+        
+        if (Seg->Size > STACK_SEGMENT_SIZE || Kept >= STACK_SEGMENT_POOL)
+        {
+            *SegPtr = Seg->Prev;
+            free(Seg);
+        }
+        else
+        {
+            Kept++;
+            SegPtr = &Seg->Prev;
+        }
+    }
 }
 #endif
 
@@ -22,26 +120,38 @@ void ShowBigList(Picoc *pc)
 void HeapInit(Picoc *pc, int StackOrHeapSize)
 {
     int Count;
+#ifdef USE_STACK_SEGMENTS
+    pc->StackSegment = NULL;
+    pc->StackSegmentPool = NULL;
+    pc->StackSegmentBytes = 0;
+    pc->StackMaxBytes = (StackOrHeapSize > STACK_SEGMENT_SIZE) ? StackOrHeapSize : STACK_SEGMENT_SIZE;
+    pc->HeapStackTop = NULL;
+    if (!HeapStackGrow(pc, 0))
+        ProgramFailNoParser(pc, "out of memory\n");
+        
+    pc->StackFrame = pc->HeapStackTop;
+    *(void **)(pc->StackFrame) = NULL;
+#else
     int AlignOffset = 0;
     
-#ifdef USE_MALLOC_STACK
+# ifdef USE_MALLOC_STACK
     pc->HeapMemory = malloc(StackOrHeapSize);
     pc->HeapBottom = NULL;                     /* the bottom of the (downward-growing) heap */
     pc->StackFrame = NULL;                     /* the current stack frame */
     pc->HeapStackTop = NULL;                          /* the top of the stack */
-#else
-# ifdef SURVEYOR_HOST
+# else
+#  ifdef SURVEYOR_HOST
     pc->HeapMemory = (unsigned char *)C_HEAPSTART;      /* all memory - stack and heap */
     pc->HeapBottom = (void *)C_HEAPSTART + HEAP_SIZE;  /* the bottom of the (downward-growing) heap */
     pc->StackFrame = (void *)C_HEAPSTART;              /* the current stack frame */
     pc->HeapStackTop = (void *)C_HEAPSTART;                   /* the top of the stack */
     pc->HeapMemStart = (void *)C_HEAPSTART;
-# else
-    pc->HeapBottom = &HeapMemory[HEAP_SIZE];   /* the bottom of the (downward-growing) heap */
-    pc->StackFrame = &HeapMemory[0];           /* the current stack frame */
-    pc->HeapStackTop = &HeapMemory[0];                /* the top of the stack */
+#  else
+    pc->HeapBottom = &(pc->HeapMemory)[HEAP_SIZE];     /* the bottom of the (downward-growing) heap */
+    pc->StackFrame = &(pc->HeapMemory)[0];             /* the current stack frame */
+    pc->HeapStackTop = &(pc->HeapMemory)[0];                  /* the top of the stack */
+#  endif
 # endif
-#endif
 
     while (((unsigned long)&pc->HeapMemory[AlignOffset] & (sizeof(ALIGN_TYPE)-1)) != 0)
         AlignOffset++;
@@ -50,21 +160,100 @@ void HeapInit(Picoc *pc, int StackOrHeapSize)
     pc->HeapStackTop = &(pc->HeapMemory)[AlignOffset];
     *(void **)(pc->StackFrame) = NULL;
     pc->HeapBottom = &(pc->HeapMemory)[StackOrHeapSize-sizeof(ALIGN_TYPE)+AlignOffset];
-    pc->FreeListBig = NULL;
-    for (Count = 0; Count < FREELIST_BUCKETS; Count++)
-        pc->FreeListBucket[Count] = NULL;
+#endif
+        
+#ifdef USE_MALLOC_HEAP
+    pc->ArenaChunks = NULL;
+    pc->ArenaPos = NULL;
+    pc->ArenaEnd = NULL;
+    for (Count = 0; Count <= ARENA_SIZE_CLASSES; Count++)
+        pc->ArenaFreeList[Count] = NULL;
+        
+    pc->ArenaBigBlocks = NULL;
+    pc->ResetPoint = NULL;
+#else
+    pc->HeapTop = pc->HeapBottom;
+    pc->HeapInUse = 0;
+    pc->HeapFreeBytes = 0;
+    pc->HeapFreeBlocks = 0;
+    pc->FreeListMap = 0;
+    for (Count = 0; Count < HEAP_FREELISTS; Count++)
+        pc->FreeList[Count] = NULL;
+#endif
 }
 
 void HeapCleanup(Picoc *pc)
 {
-#ifdef USE_MALLOC_STACK
+#ifdef USE_MALLOC_HEAP
+    int Count;
+    
+    /* all the small blocks go at once with the chunks they came from */
+    while (pc->ArenaChunks != NULL)
+    {
+        void *NextChunk = *(void **)pc->ArenaChunks;
+        free(pc->ArenaChunks);
+        pc->ArenaChunks = NextChunk;
+    }
+    
+    /* as do any big blocks which are left, including those kept for a reset */
+    while (pc->ArenaBigBlocks != NULL)
+    {
+        struct ArenaBigBlock *Next = pc->ArenaBigBlocks->Next;
+        free(pc->ArenaBigBlocks);
+        pc->ArenaBigBlocks = Next;
+    }
+    
+    if (pc->ResetPoint != NULL)
+    {
+        /* the blocks the program had malloc()ed at the reset point were kept for it */
+        for (Count = 0; pc->ResetPoint->Saved != NULL && Count < pc->ResetPoint->Saved->TotalMallocs; Count++)
+            free((void *)pc->ResetPoint->Saved->MallocInfo[Count][0]);
+            
+        free(pc->ResetPoint->Saved);
+        free(pc->ResetPoint->Current);
+        free(pc->ResetPoint->ArenaImage);
+        free(pc->ResetPoint->MallocImage);
+        free(pc->ResetPoint);
+        pc->ResetPoint = NULL;
+    }
+#endif
+#ifdef USE_STACK_SEGMENTS
+    while (pc->StackSegment != NULL)
+    {
+        struct StackSegment *Prev = pc->StackSegment->Prev;
+        free(pc->StackSegment);
+        pc->StackSegment = Prev;
+    }
+    
+    while (pc->StackSegmentPool != NULL)
+    {
+        struct StackSegment *Prev = pc->StackSegmentPool->Prev;
+        free(pc->StackSegmentPool);
+        pc->StackSegmentPool = Prev;
+    }
+#else
+# ifdef USE_MALLOC_STACK
     free(pc->HeapMemory);
+# endif
 #endif
 }
 
 /* allocate some space on the stack, in the current stack frame
  * clears memory. can return NULL if out of stack space */
 void *HeapAllocStack(Picoc *pc, int Size)
+{
+    void *NewMem = HeapAllocStackUninitialised(pc, Size);
+    
+    if (NewMem != NULL)
+        memset(NewMem, '\0', Size);
+        
+    return NewMem;
+}
+
+/* allocate some space on the stack, in the current stack frame. the memory 
+ * isn't cleared so it's for callers which fill it all in themselves. 
+ * can return NULL if out of stack space */
+void *HeapAllocStackUninitialised(Picoc *pc, int Size)
 {
     char *NewMem = pc->HeapStackTop;
     char *NewTop = (char *)pc->HeapStackTop + MEM_ALIGN(Size);
@@ -72,10 +261,20 @@ void *HeapAllocStack(Picoc *pc, int Size)
     printf("HeapAllocStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop);
 #endif
     if (NewTop > (char *)pc->HeapBottom)
+    {
+#ifdef USE_STACK_SEGMENTS
+        /* allocations never straddle segments so start a new one */
+        if (!HeapStackGrow(pc, Size))
+            return NULL;
+            
+        NewMem = pc->HeapStackTop;
+        NewTop = NewMem + MEM_ALIGN(Size);
+#else
         return NULL;
+#endif
+    }
         
     pc->HeapStackTop = (void *)NewTop;
-    memset((void *)NewMem, '\0', Size);
     return NewMem;
 }
 
@@ -92,8 +291,21 @@ void HeapUnpopStack(Picoc *pc, int Size)
 int HeapPopStack(Picoc *pc, void *Addr, int Size)
 {
     int ToLose = MEM_ALIGN(Size);
+#ifdef USE_STACK_SEGMENTS
+    /* what's being popped can run back into the segments below. the gap left 
+     * at the end of a segment was never used so it isn't counted */
+    while (ToLose > ((char *)pc->HeapStackTop - STACK_SEGMENT_DATA(pc->StackSegment)))
+    {
+        if (pc->StackSegment->Prev == NULL)
+            return FALSE;
+            
+        ToLose -= (char *)pc->HeapStackTop - STACK_SEGMENT_DATA(pc->StackSegment);
+        HeapStackRelease(pc);
+    }
+#else
     if (ToLose > ((char *)pc->HeapStackTop - (char *)&(pc->HeapMemory)[0]))
         return FALSE;
+#endif
     
 #ifdef DEBUG_HEAP
     printf("HeapPopStack(0x%lx, %ld) back to 0x%lx\n", (unsigned long)Addr, (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop - ToLose);
@@ -109,6 +321,11 @@ void HeapPushStackFrame(Picoc *pc)
 {
 #ifdef DEBUG_HEAP
     printf("Adding stack frame at 0x%lx\n", (unsigned long)pc->HeapStackTop);
+#endif
+#ifdef USE_STACK_SEGMENTS
+    HeapStackTrimPool(pc);
+    if ((char *)pc->HeapStackTop + MEM_ALIGN(sizeof(ALIGN_TYPE)) > (char *)pc->HeapBottom && !HeapStackGrow(pc, sizeof(ALIGN_TYPE)))
+        ProgramFailNoParser(pc, "out of memory\n");
 #endif
     *(void **)pc->HeapStackTop = pc->StackFrame;
     pc->StackFrame = pc->HeapStackTop;
@@ -120,6 +337,11 @@ int HeapPopStackFrame(Picoc *pc)
 {
     if (*(void **)pc->StackFrame != NULL)
     {
+#ifdef USE_STACK_SEGMENTS
+        /* whole segments above the frame go back to the pool */
+        while ((char *)pc->StackFrame < STACK_SEGMENT_DATA(pc->StackSegment) || (char *)pc->StackFrame >= pc->StackSegment->End)
+            HeapStackRelease(pc);
+#endif
         pc->HeapStackTop = pc->StackFrame;
         pc->StackFrame = *(void **)pc->StackFrame;
 #ifdef DEBUG_HEAP
@@ -131,148 +353,496 @@ int HeapPopStackFrame(Picoc *pc)
         return FALSE;
 }
 
-/* allocate some dynamically allocated memory. memory is cleared. can return NULL if out of memory */
-void *HeapAllocMem(Picoc *pc, int Size)
-{
 #ifdef USE_MALLOC_HEAP
-    return calloc(Size, 1);
-#else
-    struct AllocNode *NewMem = NULL;
-    struct AllocNode **FreeNode;
-    int AllocSize = MEM_ALIGN(Size) + MEM_ALIGN(sizeof(NewMem->Size));
-    int Bucket;
-    void *ReturnMem;
+#define ARENA_BIG_BLOCK_DATA(b) ((char *)(b) + MEM_ALIGN(sizeof(struct ArenaBigBlock)) + MEM_ALIGN(sizeof(unsigned int)))
+
+/* the malloc() heap keeps small blocks in big chunks of memory rather than 
+ * making a separate malloc() for each one. this is where most of the table 
+ * entries, values and types live. each block has a small header giving its 
+ * size class, and freed blocks go on a freelist for their class. blocks too 
+ * big for a class are malloc()ed on their own with a size class of 0 */
+static void *HeapArenaAlloc(Picoc *pc, int Size)
+{
+    struct AllocNode *NewMem;
+    int Class = MEM_ALIGN(Size) / sizeof(ALIGN_TYPE);
+    int AllocSize;
     
-    if (Size == 0)
-        return NULL;
+    if (Class == 0)
+        Class = 1;
     
-    assert(Size > 0);
+    if (Class > ARENA_SIZE_CLASSES)
+    {
+        /* a big block gets its own malloc(), and goes on a list so a reset can find it */
+        struct ArenaBigBlock *Big = malloc(MEM_ALIGN(sizeof(struct ArenaBigBlock)) + MEM_ALIGN(sizeof(NewMem->Size)) + Size);
+        if (Big == NULL)
+            return NULL;
+            
+        Big->Prev = NULL;
+        Big->Next = pc->ArenaBigBlocks;
+        Big->Size = Size;
+        Big->Kept = FALSE;
+        if (Big->Next != NULL)
+            Big->Next->Prev = Big;
+            
+        pc->ArenaBigBlocks = Big;
+        NewMem = (struct AllocNode *)((char *)Big + MEM_ALIGN(sizeof(struct ArenaBigBlock)));
+        NewMem->Size = 0;
+    }
+    else if (pc->ArenaFreeList[Class] != NULL)
+    {
+        /* reuse a block of the same size */
+        NewMem = pc->ArenaFreeList[Class];
+        pc->ArenaFreeList[Class] = *(struct AllocNode **)NewMem;
+        NewMem->Size = Class;
+    }
+    else
+    {
+        /* carve a new block from the current chunk */
+        AllocSize = MEM_ALIGN(sizeof(NewMem->Size)) + Class * sizeof(ALIGN_TYPE);
+        if (pc->ArenaPos == NULL || pc->ArenaEnd - pc->ArenaPos < AllocSize)
+        {
+            void *NewChunk = malloc(ARENA_CHUNK_SIZE);
+            if (NewChunk == NULL)
+                return NULL;
+                
+            *(void **)NewChunk = pc->ArenaChunks;
+            pc->ArenaChunks = NewChunk;
+            pc->ArenaPos = (char *)NewChunk + MEM_ALIGN(sizeof(void *));
+            pc->ArenaEnd = (char *)NewChunk + ARENA_CHUNK_SIZE;
+        }
+        
+        NewMem = (struct AllocNode *)pc->ArenaPos;
+        pc->ArenaPos += AllocSize;
+        NewMem->Size = Class;
+    }
     
-    /* make sure we have enough space for an AllocNode */
-    if (AllocSize < sizeof(struct AllocNode))
-        AllocSize = sizeof(struct AllocNode);
+    return (void *)((char *)NewMem + MEM_ALIGN(sizeof(NewMem->Size)));
+}
+
+/* free a block from HeapArenaAlloc() */
+static void HeapArenaFree(Picoc *pc, void *Mem)
+{
+    struct AllocNode *MemNode;
     
-    Bucket = AllocSize >> 2;
-    if (Bucket < FREELIST_BUCKETS && pc->FreeListBucket[Bucket] != NULL)
-    { 
-        /* try to allocate from a freelist bucket first */
-#ifdef DEBUG_HEAP
-        printf("allocating %d(%d) from bucket", Size, AllocSize);
+    if (Mem == NULL)
+        return;
+        
+    MemNode = (struct AllocNode *)((char *)Mem - MEM_ALIGN(sizeof(MemNode->Size)));
+    if (MemNode->Size == 0)
+    {
+        struct ArenaBigBlock *Big = (struct ArenaBigBlock *)((char *)MemNode - MEM_ALIGN(sizeof(struct ArenaBigBlock)));
+        
+        /* a block from before the reset point has to be there to go back to */
+        if (Big->Kept)
+            return;
+            
+        if (Big->Prev != NULL)
+            Big->Prev->Next = Big->Next;
+        else
+            pc->ArenaBigBlocks = Big->Next;
+            
+        if (Big->Next != NULL)
+            Big->Next->Prev = Big->Prev;
+            
+        free(Big);
+    }
+    else
+    {
+        assert(MemNode->Size <= ARENA_SIZE_CLASSES);
+        *(struct AllocNode **)MemNode = pc->ArenaFreeList[MemNode->Size];
+        pc->ArenaFreeList[MemNode->Size] = MemNode;
+    }
+}
+
+/* how much of a chunk was in use when the reset point was set */
+static int HeapResetChunkSize(struct ResetPoint *Point, void *Chunk)
+{
+    if (Chunk == Point->ArenaChunks)
+        return Point->ArenaPos - (char *)Chunk;
+    else
+        return ARENA_CHUNK_SIZE;
+}
+
+/* start a reset point by taking a copy of everything in the malloc() heap. 
+ * big blocks which are there now are kept from then on, even if they're freed,
+ * so the copy can be put back into them. the copy of the rest of the 
+ * interpreter is left to the caller */
+void HeapSaveResetPoint(Picoc *pc)
+{
+    struct ResetPoint *Point = pc->ResetPoint;
+    struct ArenaBigBlock *Big;
+    void *Chunk;
+    long ImageSize = 0;
+    char *Image;
+    
+    if (Point == NULL)
+    {
+        Point = calloc(1, sizeof(struct ResetPoint));
+        if (Point == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+            
+        pc->ResetPoint = Point;
+    }
+    
+    free(Point->ArenaImage);
+    Point->ArenaImage = NULL;
+    if (Point->Saved == NULL)
+        Point->Saved = calloc(1, sizeof(Picoc));
+        
+    if (Point->Current == NULL)
+        Point->Current = malloc(sizeof(Picoc));
+        
+    if (Point->Saved == NULL || Point->Current == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+        
+    Point->ArenaChunks = pc->ArenaChunks;
+    Point->ArenaPos = pc->ArenaPos;
+    for (Chunk = pc->ArenaChunks; Chunk != NULL; Chunk = *(void **)Chunk)
+        ImageSize += HeapResetChunkSize(Point, Chunk);
+        
+    for (Big = pc->ArenaBigBlocks; Big != NULL; Big = Big->Next)
+        ImageSize += Big->Size;
+        
+    Point->ArenaImage = malloc(ImageSize > 0 ? ImageSize : 1);
+    if (Point->ArenaImage == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+        
+    Image = Point->ArenaImage;
+    for (Chunk = pc->ArenaChunks; Chunk != NULL; Chunk = *(void **)Chunk)
+    {
+        memcpy(Image, Chunk, HeapResetChunkSize(Point, Chunk));
+        Image += HeapResetChunkSize(Point, Chunk);
+    }
+    
+    for (Big = pc->ArenaBigBlocks; Big != NULL; Big = Big->Next)
+    {
+        memcpy(Image, ARENA_BIG_BLOCK_DATA(Big), Big->Size);
+        Image += Big->Size;
+        Big->Kept = TRUE;
+    }
+}
+
+/* take the heap and stack back to the reset point. Point->Current has the
+ * interpreter as it was before the reset and the rest of the interpreter has
+ * already been put back to Point->Saved. the time this takes depends on what
+ * there was at the reset point, not on what's been allocated since. only the 
+ * chunks and big blocks allocated since have to be freed, and they're at the
+ * start of their lists */
+void HeapRestoreResetPoint(Picoc *pc)
+{
+    struct ResetPoint *Point = pc->ResetPoint;
+    Picoc *Now = Point->Current;
+    struct ArenaBigBlock *Big;
+    struct ArenaBigBlock *NextBig;
+    void *Chunk;
+    char *Image = Point->ArenaImage;
+    
+    while (Now->ArenaChunks != Point->ArenaChunks)
+    {
+        Chunk = *(void **)Now->ArenaChunks;
+        free(Now->ArenaChunks);
+        Now->ArenaChunks = Chunk;
+    }
+    
+    for (Big = Now->ArenaBigBlocks; Big != NULL && !Big->Kept; Big = NextBig)
+    {
+        NextBig = Big->Next;
+        free(Big);
+    }
+    
+    pc->ArenaBigBlocks = Big;
+    if (Big != NULL)
+        Big->Prev = NULL;
+        
+    /* the saved part of the interpreter has the chunk positions and freelists
+     * to go with the contents */
+    for (Chunk = pc->ArenaChunks; Chunk != NULL; Chunk = *(void **)Chunk)
+    {
+        memcpy(Chunk, Image, HeapResetChunkSize(Point, Chunk));
+        Image += HeapResetChunkSize(Point, Chunk);
+    }
+    
+    for (Big = pc->ArenaBigBlocks; Big != NULL; Big = Big->Next)
+    {
+        memcpy(ARENA_BIG_BLOCK_DATA(Big), Image, Big->Size);
+        Image += Big->Size;
+    }
+    
+#ifdef USE_STACK_SEGMENTS
+    /* the stack goes back to its first segment, keeping the spares */
+    pc->StackSegment = Now->StackSegment;
+    pc->StackSegmentPool = Now->StackSegmentPool;
+    pc->StackSegmentBytes = Now->StackSegmentBytes;
+    pc->HeapBottom = Now->HeapBottom;
+    pc->HeapStackTop = Now->HeapStackTop;
+    while (pc->StackSegment->Prev != NULL)
+        HeapStackRelease(pc);
+        
+    HeapStackTrimPool(pc);
 #endif
-        NewMem = pc->FreeListBucket[Bucket];
-        assert((unsigned long)NewMem >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)NewMem - &(pc->HeapMemory)[0] < HEAP_SIZE);
-        pc->FreeListBucket[Bucket] = *(struct AllocNode **)NewMem;
-        assert(pc->FreeListBucket[Bucket] == NULL || ((unsigned long)pc->FreeListBucket[Bucket] >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)pc->FreeListBucket[Bucket] - &(pc->HeapMemory)[0] < HEAP_SIZE));
-        NewMem->Size = AllocSize;
+    pc->StackFrame = Point->Saved->StackFrame;
+    pc->HeapStackTop = Point->Saved->HeapStackTop;
+}
+#else
+/* which freelist a free block of this size goes on. there's a freelist for 
+ * each small size, then one for each power of two range of sizes */
+static int HeapFreeListIndex(int Size)
+{
+    int Units = Size / sizeof(ALIGN_TYPE);
+    int Index = HEAP_EXACT_FREELISTS;
+    
+    if (Units < HEAP_EXACT_FREELISTS)
+        return Units;
+    
+    for (Units /= HEAP_EXACT_FREELISTS; Units > 1 && Index < HEAP_FREELISTS-1; Units >>= 1)
+        Index++;
+        
+    return Index;
+}
+
+/* put a block on the freelist for its size and tell the block above it */
+static void HeapFreeListAdd(Picoc *pc, struct AllocNode *Node, int Size)
+{
+    int Index = HeapFreeListIndex(Size);
+    struct AllocNode *Next = (struct AllocNode *)((char *)Node + Size);
+    
+    Node->Size = Size;
+    *(unsigned int *)((char *)Node + Size - HEAP_TAG_SIZE) = Size;
+    Node->PrevFree = NULL;
+    Node->NextFree = pc->FreeList[Index];
+    if (Node->NextFree != NULL)
+        Node->NextFree->PrevFree = Node;
+        
+    pc->FreeList[Index] = Node;
+    pc->FreeListMap |= 1UL << Index;
+    pc->HeapFreeBytes += Size;
+    pc->HeapFreeBlocks++;
+    
+    if ((void *)Next < pc->HeapTop)
+        Next->Size |= HEAP_PREV_FREE;
+}
+
+/* take a block off its freelist */
+static void HeapFreeListRemove(Picoc *pc, struct AllocNode *Node)
+{
+    int Size = HEAP_BLOCK_SIZE(Node);
+    int Index = HeapFreeListIndex(Size);
+    
+    if (Node->PrevFree != NULL)
+        Node->PrevFree->NextFree = Node->NextFree;
+    else
+        pc->FreeList[Index] = Node->NextFree;
+        
+    if (Node->NextFree != NULL)
+        Node->NextFree->PrevFree = Node->PrevFree;
+        
+    if (pc->FreeList[Index] == NULL)
+        pc->FreeListMap &= ~(1UL << Index);
+        
+    pc->HeapFreeBytes -= Size;
+    pc->HeapFreeBlocks--;
+}
+
+/* find a free block of at least this size, or NULL if there isn't one */
+static struct AllocNode *HeapFreeListFind(Picoc *pc, int AllocSize)
+{
+    int Index = HeapFreeListIndex(AllocSize);
+    struct AllocNode *Node;
+    unsigned long Map;
+    
+    /* the blocks in a range freelist might be too small so check them */
+    for (Node = pc->FreeList[Index]; Node != NULL; Node = Node->NextFree)
+    {
+        if (HEAP_BLOCK_SIZE(Node) >= AllocSize)
+            return Node;
     }
-    else if (pc->FreeListBig != NULL)
-    { 
-        /* grab the first item from the "big" freelist we can fit in */
-        for (FreeNode = &pc->FreeListBig; *FreeNode != NULL && (*FreeNode)->Size < AllocSize; FreeNode = &(*FreeNode)->NextFree)
-        {}
+    
+    /* anything on a higher freelist is big enough - take the first non-empty one */
+    Map = pc->FreeListMap & ~((2UL << Index) - 1);
+    if (Map == 0)
+        return NULL;
+        
+    for (Index++; (Map & (1UL << Index)) == 0; Index++)
+    {}
+    
+    return pc->FreeList[Index];
+}
+
+/* allocate from the built-in heap. blocks are found on segregated freelists 
+ * and split if they're much bigger than we need. if there's nothing suitable 
+ * the heap grows down towards the stack */
+static void *HeapFitAlloc(Picoc *pc, int Size)
+{
+    struct AllocNode *NewMem;
+    struct AllocNode *Next;
+    int AllocSize = HEAP_TAG_SIZE + MEM_ALIGN(Size);
+    int FreeSize;
+    
+    if (Size == 0)
+        return NULL;
+    
+    assert(Size > 0);
+    if (AllocSize < HEAP_MIN_BLOCK)
+        AllocSize = HEAP_MIN_BLOCK;
         
-        if (*FreeNode != NULL)
+    NewMem = HeapFreeListFind(pc, AllocSize);
+    if (NewMem != NULL)
+    {
+        FreeSize = HEAP_BLOCK_SIZE(NewMem);
+        HeapFreeListRemove(pc, NewMem);
+        if (FreeSize - AllocSize >= HEAP_MIN_BLOCK)
         {
-            assert((unsigned long)*FreeNode >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)*FreeNode - &(pc->HeapMemory)[0] < HEAP_SIZE);
-            assert((*FreeNode)->Size < HEAP_SIZE && (*FreeNode)->Size > 0);
-            if ((*FreeNode)->Size < AllocSize + SPLIT_MEM_THRESHOLD)
-            { 
-                /* close in size - reduce fragmentation by not splitting */
+            /* split it, leaving the free part at the bottom */
 #ifdef DEBUG_HEAP
-               printf("allocating %d(%d) from freelist, no split (%d)", Size, AllocSize, (*FreeNode)->Size);
+            printf("allocating %d(%d) from freelist, split chunk (%d)", Size, AllocSize, FreeSize);
 #endif
-                NewMem = *FreeNode;
-                assert((unsigned long)NewMem >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)NewMem - &(pc->HeapMemory)[0] < HEAP_SIZE);
-                *FreeNode = NewMem->NextFree;
-            }
-            else
-            { 
-                /* split this big memory chunk */
+            HeapFreeListAdd(pc, NewMem, FreeSize - AllocSize);
+            NewMem = (struct AllocNode *)((char *)NewMem + FreeSize - AllocSize);
+            NewMem->Size = AllocSize | HEAP_BLOCK_USED | HEAP_PREV_FREE;
+        }
+        else
+        {
+            /* close in size - reduce fragmentation by not splitting */
 #ifdef DEBUG_HEAP
-                printf("allocating %d(%d) from freelist, split chunk (%d)", Size, AllocSize, (*FreeNode)->Size);
+            printf("allocating %d(%d) from freelist, no split (%d)", Size, AllocSize, FreeSize);
 #endif
-                NewMem = (void *)((char *)*FreeNode + (*FreeNode)->Size - AllocSize);
-                assert((unsigned long)NewMem >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)NewMem - &(pc->HeapMemory)[0] < HEAP_SIZE);
-                (*FreeNode)->Size -= AllocSize;
-                NewMem->Size = AllocSize;
-            }
+            AllocSize = FreeSize;
+            NewMem->Size = AllocSize | HEAP_BLOCK_USED;
         }
+        
+        Next = HEAP_NEXT_BLOCK(NewMem);
+        if ((void *)Next < pc->HeapTop)
+            Next->Size &= ~HEAP_PREV_FREE;
     }
-    
-    if (NewMem == NULL)
+    else
     { 
         /* couldn't allocate from a freelist - try to increase the size of the heap area */
 #ifdef DEBUG_HEAP
-        printf("allocating %d(%d) at bottom of heap (0x%lx-0x%lx)", Size, AllocSize, (long)((char *)pc->HeapBottom - AllocSize), (long)HeapBottom);
+        printf("allocating %d(%d) at bottom of heap (0x%lx-0x%lx)", Size, AllocSize, (long)((char *)pc->HeapBottom - AllocSize), (long)pc->HeapBottom);
 #endif
         if ((char *)pc->HeapBottom - AllocSize < (char *)pc->HeapStackTop)
             return NULL;
         
         pc->HeapBottom = (void *)((char *)pc->HeapBottom - AllocSize);
         NewMem = pc->HeapBottom;
-        NewMem->Size = AllocSize;
+        NewMem->Size = AllocSize | HEAP_BLOCK_USED;
     }
     
-    ReturnMem = (void *)((char *)NewMem + MEM_ALIGN(sizeof(NewMem->Size)));
-    memset(ReturnMem, '\0', AllocSize - MEM_ALIGN(sizeof(NewMem->Size)));
+    pc->HeapInUse += AllocSize;
 #ifdef DEBUG_HEAP
-    printf(" = %lx\n", (unsigned long)ReturnMem);
-#endif
-    return ReturnMem;
+    printf(" = %lx\n", (unsigned long)((char *)NewMem + HEAP_TAG_SIZE));
 #endif
+    return (void *)((char *)NewMem + HEAP_TAG_SIZE);
 }
 
-/* free some dynamically allocated memory */
-void HeapFreeMem(Picoc *pc, void *Mem)
+/* free a block from HeapFitAlloc(), merging it with any free blocks either 
+ * side of it. if it ends up at the bottom of the heap the heap shrinks instead */
+static void HeapFitFree(Picoc *pc, void *Mem)
 {
-#ifdef USE_MALLOC_HEAP
-    free(Mem);
-#else
-    struct AllocNode *MemNode = (struct AllocNode *)((char *)Mem - MEM_ALIGN(sizeof(MemNode->Size)));
-    int Bucket = MemNode->Size >> 2;
+    struct AllocNode *MemNode;
+    struct AllocNode *Next;
+    int Size;
     
-#ifdef DEBUG_HEAP
-    printf("HeapFreeMem(0x%lx)\n", (unsigned long)Mem);
-#endif
-    assert((unsigned long)Mem >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)Mem - &(pc->HeapMemory)[0] < HEAP_SIZE);
-    assert(MemNode->Size < HEAP_SIZE && MemNode->Size > 0);
     if (Mem == NULL)
         return;
-    
-    if ((void *)MemNode == pc->HeapBottom)
-    { 
-        /* pop it off the bottom of the heap, reducing the heap size */
-#ifdef DEBUG_HEAP
-        printf("freeing %d from bottom of heap\n", MemNode->Size);
-#endif
-        pc->HeapBottom = (void *)((char *)pc->HeapBottom + MemNode->Size);
+        
+    MemNode = (struct AllocNode *)((char *)Mem - HEAP_TAG_SIZE);
+    assert((void *)MemNode >= pc->HeapBottom && (void *)MemNode < pc->HeapTop);
+    assert(MemNode->Size & HEAP_BLOCK_USED);
+    Size = HEAP_BLOCK_SIZE(MemNode);
+    pc->HeapInUse -= Size;
 #ifdef DEBUG_HEAP
-        ShowBigList(pc);
+    printf("HeapFreeMem(0x%lx) %d\n", (unsigned long)Mem, Size);
 #endif
+    
+    /* merge with the block above */
+    Next = HEAP_NEXT_BLOCK(MemNode);
+    if ((void *)Next < pc->HeapTop && !(Next->Size & HEAP_BLOCK_USED))
+    {
+        HeapFreeListRemove(pc, Next);
+        Size += HEAP_BLOCK_SIZE(Next);
+    }
+    
+    /* merge with the block below */
+    if (MemNode->Size & HEAP_PREV_FREE)
+    {
+        struct AllocNode *Prev = (struct AllocNode *)((char *)MemNode - *(unsigned int *)((char *)MemNode - HEAP_TAG_SIZE));
+        
+        HeapFreeListRemove(pc, Prev);
+        Size += HEAP_BLOCK_SIZE(Prev);
+        MemNode = Prev;
     }
-    else if (Bucket < FREELIST_BUCKETS)
+    
+    if ((void *)MemNode == pc->HeapBottom)
     { 
-        /* we can fit it in a bucket */
-#ifdef DEBUG_HEAP
-        printf("freeing %d to bucket\n", MemNode->Size);
-#endif
-        assert(pc->FreeListBucket[Bucket] == NULL || ((unsigned long)pc->FreeListBucket[Bucket] >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)FreeListBucket[Bucket] - &HeapMemory[0] < HEAP_SIZE));
-        *(struct AllocNode **)MemNode = pc->FreeListBucket[Bucket];
-        pc->FreeListBucket[Bucket] = (struct AllocNode *)MemNode;
+        /* pop it off the bottom of the heap, reducing the heap size */
+        pc->HeapBottom = (void *)((char *)pc->HeapBottom + Size);
+        if (pc->HeapBottom < pc->HeapTop)
+            ((struct AllocNode *)pc->HeapBottom)->Size &= ~HEAP_PREV_FREE;
     }
     else
-    { 
-        /* put it in the big memory freelist */
-#ifdef DEBUG_HEAP
-        printf("freeing %lx:%d to freelist\n", (unsigned long)Mem, MemNode->Size);
-#endif
-        assert(pc->FreeListBig == NULL || ((unsigned long)pc->FreeListBig >= (unsigned long)&(pc->HeapMemory)[0] && (unsigned char *)pc->FreeListBig - &(pc->HeapMemory)[0] < HEAP_SIZE));
-        MemNode->NextFree = pc->FreeListBig;
-        FreeListBig = MemNode;
+        HeapFreeListAdd(pc, MemNode, Size);
+        
 #ifdef DEBUG_HEAP
-        ShowBigList(pc);
+    ShowHeapStats(pc);
 #endif
+}
+
+/* get statistics about how the heap is being used and how fragmented it is */
+void HeapGetStats(Picoc *pc, struct HeapStats *Stats)
+{
+    struct AllocNode *Node;
+    int Index;
+    
+    Stats->HeapSize = (char *)pc->HeapTop - (char *)pc->HeapBottom;
+    Stats->InUse = pc->HeapInUse;
+    Stats->FreeBytes = pc->HeapFreeBytes;
+    Stats->FreeBlocks = pc->HeapFreeBlocks;
+    Stats->LargestFree = 0;
+    
+    /* the largest free block is on the highest non-empty freelist */
+    for (Index = HEAP_FREELISTS-1; Index >= 0 && pc->FreeList[Index] == NULL; Index--)
+    {}
+    
+    if (Index >= 0)
+    {
+        for (Node = pc->FreeList[Index]; Node != NULL; Node = Node->NextFree)
+        {
+            if (HEAP_BLOCK_SIZE(Node) > Stats->LargestFree)
+                Stats->LargestFree = HEAP_BLOCK_SIZE(Node);
+        }
     }
+}
+#endif
+
+/* allocate some dynamically allocated memory. memory is cleared. can return NULL if out of memory */
+void *HeapAllocMem(Picoc *pc, int Size)
+{
+    void *NewMem = HeapAllocMemUninitialised(pc, Size);
+    
+    if (NewMem != NULL)
+        memset(NewMem, '\0', Size);
+        
+    return NewMem;
+}
+
+/* allocate some dynamically allocated memory which isn't cleared, for callers 
+ * which fill it all in themselves. can return NULL if out of memory */
+void *HeapAllocMemUninitialised(Picoc *pc, int Size)
+{
+#ifdef USE_MALLOC_HEAP
+    return HeapArenaAlloc(pc, Size);
+#else
+    return HeapFitAlloc(pc, Size);
 #endif
 }
 
+/* free some dynamically allocated memory */
+void HeapFreeMem(Picoc *pc, void *Mem)
+{
+#ifdef USE_MALLOC_HEAP
+    HeapArenaFree(pc, Mem);
+#else
+    HeapFitFree(pc, Mem);
+#endif
+}
@@ -81,16 +81,16 @@ enum LexToken
     /* 0x21 */ TokenIncrement, TokenDecrement, TokenUnaryNot, TokenUnaryExor, TokenSizeof, TokenCast,
     /* 0x27 */ TokenLeftSquareBracket, TokenRightSquareBracket, TokenDot, TokenArrow, 
     /* 0x2b */ TokenOpenBracket, TokenCloseBracket,
-    /* 0x2d */ TokenIdentifier, TokenIntegerConstant, TokenFPConstant, TokenStringConstant, TokenCharacterConstant,
-    /* 0x32 */ TokenSemicolon, TokenEllipsis,
-    /* 0x34 */ TokenLeftBrace, TokenRightBrace,
-    /* 0x36 */ TokenIntType, TokenCharType, TokenFloatType, TokenDoubleType, TokenVoidType, TokenEnumType,
-    /* 0x3c */ TokenLongType, TokenSignedType, TokenShortType, TokenStaticType, TokenAutoType, TokenRegisterType, TokenExternType, TokenStructType, TokenUnionType, TokenUnsignedType, TokenTypedef,
-    /* 0x46 */ TokenContinue, TokenDo, TokenElse, TokenFor, TokenGoto, TokenIf, TokenWhile, TokenBreak, TokenSwitch, TokenCase, TokenDefault, TokenReturn,
-    /* 0x52 */ TokenHashDefine, TokenHashInclude, TokenHashIf, TokenHashIfdef, TokenHashIfndef, TokenHashElse, TokenHashEndif,
-    /* 0x59 */ TokenNew, TokenDelete,
-    /* 0x5b */ TokenOpenMacroBracket,
-    /* 0x5c */ TokenEOF, TokenEndOfLine, TokenEndOfFunction
+    /* 0x2d */ TokenIdentifier, TokenIntegerConstant, TokenFPConstant, TokenStringConstant, TokenCharacterConstant, TokenFoldedConstant,
+    /* 0x33 */ TokenSemicolon, TokenEllipsis,
+    /* 0x35 */ TokenLeftBrace, TokenRightBrace,
+    /* 0x37 */ TokenIntType, TokenCharType, TokenFloatType, TokenDoubleType, TokenVoidType, TokenEnumType,
+    /* 0x3d */ TokenLongType, TokenSignedType, TokenShortType, TokenStaticType, TokenAutoType, TokenRegisterType, TokenExternType, TokenStructType, TokenUnionType, TokenUnsignedType, TokenTypedef,
+    /* 0x47 */ TokenContinue, TokenDo, TokenElse, TokenFor, TokenGoto, TokenIf, TokenWhile, TokenBreak, TokenSwitch, TokenCase, TokenDefault, TokenReturn,
+    /* 0x53 */ TokenHashDefine, TokenHashInclude, TokenHashIf, TokenHashIfdef, TokenHashIfndef, TokenHashElse, TokenHashEndif,
+    /* 0x5a */ TokenNew, TokenDelete,
+    /* 0x5c */ TokenOpenMacroBracket, TokenMacroParameter,
+    /* 0x5e */ TokenEOF, TokenEndOfLine, TokenEndOfFunction
 };
 
 /* used in dynamic memory allocation */
@@ -98,6 +98,47 @@ struct AllocNode
 {
     unsigned int Size;
     struct AllocNode *NextFree;
+    struct AllocNode *PrevFree;
+};
+
+/* a block too big for the malloc() heap's size classes, which is malloc()ed on
+ * its own. its AllocNode size tag follows this header */
+struct ArenaBigBlock
+{
+    struct ArenaBigBlock *Prev;
+    struct ArenaBigBlock *Next;
+    int Size;                       /* the size of the block's data */
+    int Kept;                       /* it was there when the reset point was set so it's never freed */
+};
+
+/* what PicocReset() takes an interpreter back to */
+struct ResetPoint
+{
+    struct Picoc_Struct *Saved;     /* the interpreter as it was */
+    struct Picoc_Struct *Current;   /* room to put the interpreter aside while it's reset */
+    void *ArenaChunks;              /* the malloc() heap's chunks at the time */
+    char *ArenaPos;                 /* how much of the newest one was used */
+    char *ArenaImage;               /* what was in those chunks and the big blocks */
+    char *MallocImage;              /* what was in the blocks the program had malloc()ed */
+};
+
+/* a piece of a segmented stack. the stack memory follows this header */
+struct StackSegment
+{
+    struct StackSegment *Prev;      /* the segment below this one */
+    void *PrevTop;                  /* the top of the stack in the segment below when this one was started */
+    char *End;                      /* the end of this segment's memory */
+    int Size;                       /* the size of this segment including the header */
+};
+
+/* how the built-in heap is being used */
+struct HeapStats
+{
+    int HeapSize;                   /* bytes from the bottom of the heap to the top */
+    int InUse;                      /* bytes in allocated blocks, including their size tags */
+    int FreeBytes;                  /* bytes in free blocks */
+    int FreeBlocks;                 /* the number of free blocks */
+    int LargestFree;                /* the size of the biggest free block */
 };
 
 /* whether we're running or skipping code */
@@ -112,6 +153,11 @@ enum RunMode
     RunModeGoto                 /* searching for a goto label */
 };
 
+/* scope IDs which no block ever gets, so the scopes blocks end never take in
+ * values which have these */
+#define SCOPE_ID_NONE -1            /* not tracked - defined with no parser, or while scopes are off */
+#define SCOPE_ID_TOP_LEVEL 0        /* at the top level of a parser, outside any block */
+
 /* parser state - has all this detail so we can parse nested files */
 struct ParseState
 {
@@ -128,6 +174,7 @@ struct ParseState
     short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch, what the last evaluated level was */
     char DebugMode;             /* debugging mode */
     int ScopeID;                /* for keeping track of local variables (free them after they go out of scope) */
+    struct Value **MacroArgs;   /* the arguments of the macro whose body we're evaluating */
 };
 
 /* values */
@@ -167,6 +214,7 @@ struct ValueType
     struct ValueType *FromType;     /* the type we're derived from (or NULL) */
     struct ValueType *DerivedTypeList;  /* first in a list of types derived from this one */
     struct ValueType *Next;         /* next item in the derived type list */
+    struct ValueType *HashNext;     /* next item in this type intern table chain */
     struct Table *Members;          /* members of a struct or union */
     int OnHeap;                     /* true if allocated on the heap */
     int StaticQualifier;            /* true if it's a static */
@@ -189,6 +237,7 @@ struct MacroDef
 {
     int NumParams;                  /* the number of parameters */
     char **ParamName;               /* array of parameter names */
+    int IsTemplate;                 /* parameters in the body have been replaced by TokenMacroParameter */
     struct ParseState Body;         /* lexical tokens of the function body if not intrinsic */
 };
 
@@ -223,6 +272,7 @@ struct Value
     char ValOnStack;                /* the AnyValue is on the stack along with this Value */
     char AnyValOnHeap;              /* the AnyValue is separately allocated from the Value on the heap */
     char IsLValue;                  /* is modifiable and is allocated somewhere we can usefully modify it */
+    char IsConstant;                /* never changes once defined, like an enum constant */
     int ScopeID;                    /* to know when it goes out of scope */
     char OutOfScope;
 };
@@ -230,7 +280,6 @@ struct Value
 /* hash table data structure */
 struct TableEntry
 {
-    struct TableEntry *Next;        /* next item in this hash chain */
     const char *DeclFileName;       /* where the variable was declared */
     unsigned short DeclLine;
     unsigned short DeclColumn;
@@ -243,7 +292,12 @@ struct TableEntry
             struct Value *Val;      /* the value we're storing */
         } v;                        /* used for tables of values */
         
-        char Key[1];                /* dummy size - used for the shared string table */
+        struct StringEntry
+        {
+            unsigned int Hash;      /* full hash of the string so we rarely need to compare it */
+            int Len;                /* length of the string */
+            char Key[1];            /* dummy size - the string follows */
+        } s;                        /* used for the shared string table */
         
         struct BreakpointEntry      /* defines a breakpoint */
         {
@@ -257,11 +311,53 @@ struct TableEntry
     
 struct Table
 {
-    short Size;
-    short OnHeap;
+    int Size;                       /* number of slots - always a power of two */
+    int Count;                      /* number of slots in use */
+    short OnHeap;                   /* entries are allocated on the heap rather than the stack */
+    short HashTableOnHeap;          /* the slot array has been grown onto the heap */
     struct TableEntry **HashTable;
 };
 
+/* a struct or union member reference resolved at a particular token position */
+struct MemberCacheEntry
+{
+    const unsigned char *Pos;       /* position of the member identifier token */
+    struct ValueType *StructType;   /* the struct or union type it was resolved against */
+    const char *Identifier;         /* the member name */
+    struct ValueType *MemberType;   /* the member's type */
+    int Offset;                     /* the member's offset within the struct */
+};
+
+#define MEMBER_CACHE_HASH(p) ((((unsigned long)(p)) ^ (((unsigned long)(p)) >> 9)) & (MEMBER_CACHE_SIZE-1))
+
+/* the global storage of a static variable resolved at a particular declaration */
+struct StaticCacheEntry
+{
+    const unsigned char *Pos;       /* position just after the declared identifier */
+    const char *FileName;           /* the file, function and name which make up the mangled name */
+    const char *FuncName;
+    const char *Identifier;
+    struct Value *Storage;          /* the static variable itself */
+};
+
+#define STATIC_CACHE_HASH(p) ((((unsigned long)(p)) ^ (((unsigned long)(p)) >> 9)) & (STATIC_CACHE_SIZE-1))
+
+/* the contents of a variable after running a constant array initialiser, replayed on later runs */
+struct InitialiserImage
+{
+    const unsigned char *Pos;       /* position of the initialiser's opening brace */
+    struct ValueType *DeclType;     /* the type the variable was declared with */
+    struct ValueType *Typ;          /* the type after sizing an unsized array */
+    const unsigned char *EndPos;    /* where parsing continues after the closing brace */
+    short int EndLine;
+    short int EndCharacterPos;
+    int Size;                       /* size of the image in bytes */
+    struct InitialiserImage *Next;  /* next image in this hash chain */
+    unsigned char Data[1];          /* placeholder for where the image starts */
+};
+
+#define INITIALISER_IMAGE_HASH(p) ((((unsigned long)(p)) ^ (((unsigned long)(p)) >> 9)) & (INITIALISER_IMAGE_TABLE_SIZE-1))
+
 /* stack frame for function calls */
 struct StackFrame
 {
@@ -354,9 +450,11 @@ struct IncludeLibrary
     struct IncludeLibrary *NextLib;
 };
 
-#define FREELIST_BUCKETS 8                          /* freelists for 4, 8, 12 ... 32 byte allocs */
-#define SPLIT_MEM_THRESHOLD 16                      /* don't split memory which is close in size */
-#define BREAKPOINT_TABLE_SIZE 21
+#define HEAP_FREELISTS 32                           /* freelists for free blocks of the built-in heap */
+#define HEAP_EXACT_FREELISTS 16                     /* blocks up to this many ALIGN_TYPEs have a freelist per size */
+#define ARENA_CHUNK_SIZE (64*1024)                  /* the malloc() heap gets memory for small blocks this much at a time */
+#define ARENA_SIZE_CLASSES 32                       /* freelists for 1, 2, 3 ... 32 ALIGN_TYPE sized blocks */
+#define BREAKPOINT_TABLE_SIZE 16          /* must be a power of two */
 
 
 /* the entire state of the picoc system */
@@ -374,15 +472,24 @@ struct Picoc_Struct
     int LexUseStatementPrompt;
     union AnyValue LexAnyValue;
     struct Value LexValue;
-    struct Table ReservedWordTable;
-    struct TableEntry *ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
 
     /* the table of string literal values */
     struct Table StringLiteralTable;
     struct TableEntry *StringLiteralHashTable[STRING_LITERAL_TABLE_SIZE];
     
+    /* struct member references which have already been resolved */
+    struct MemberCacheEntry MemberCache[MEMBER_CACHE_SIZE];
+    
+    /* static variables which have already been resolved */
+    struct StaticCacheEntry StaticCache[STATIC_CACHE_SIZE];
+    
+    /* byte images of constant array initialisers which have already been run */
+    struct InitialiserImage *InitialiserImages[INITIALISER_IMAGE_TABLE_SIZE];
+    
     /* the stack */
     struct StackFrame *TopStackFrame;
+    unsigned long CStackLimit;          /* calls fail with "stack overflow" if the C stack grows below this address */
+    unsigned long CStackTop;            /* the top of the C stack CStackLimit was worked out for */
 
     /* the value passed to exit() */
     int PicocExitValue;
@@ -392,8 +499,16 @@ struct Picoc_Struct
 
     /* heap memory */
 #ifdef USE_MALLOC_STACK
+# ifdef USE_STACK_SEGMENTS
+    struct StackSegment *StackSegment;  /* the segment the top of the stack is in */
+    struct StackSegment *StackSegmentPool;  /* released segments kept for reuse */
+    int StackSegmentBytes;              /* the size of all the segments in use */
+    int StackMaxBytes;                  /* the stack can't grow beyond this */
+    void *HeapBottom;                   /* the end of the current stack segment */
+# else
     unsigned char *HeapMemory;          /* stack memory since our heap is malloc()ed */
     void *HeapBottom;                   /* the bottom of the (downward-growing) heap */
+# endif
     void *StackFrame;                   /* the current stack frame */
     void *HeapStackTop;                 /* the top of the stack */
 #else
@@ -411,8 +526,21 @@ struct Picoc_Struct
 # endif
 #endif
 
-    struct AllocNode *FreeListBucket[FREELIST_BUCKETS];      /* we keep a pool of freelist buckets to reduce fragmentation */
-    struct AllocNode *FreeListBig;                           /* free memory which doesn't fit in a bucket */
+#ifndef USE_MALLOC_HEAP
+    void *HeapTop;                      /* the top of the heap, which it grows down from */
+    struct AllocNode *FreeList[HEAP_FREELISTS];     /* free blocks by size */
+    unsigned long FreeListMap;          /* bit n is set if FreeList[n] isn't empty */
+    int HeapInUse;                      /* bytes in allocated blocks */
+    int HeapFreeBytes;                  /* bytes in free blocks */
+    int HeapFreeBlocks;                 /* the number of free blocks */
+#else
+    void *ArenaChunks;                  /* list of chunks small heap blocks are carved from */
+    char *ArenaPos;                     /* the unused part of the current chunk */
+    char *ArenaEnd;
+    struct AllocNode *ArenaFreeList[ARENA_SIZE_CLASSES+1];  /* freed small blocks by size class */
+    struct ArenaBigBlock *ArenaBigBlocks;   /* blocks too big for a size class, newest first */
+    struct ResetPoint *ResetPoint;      /* set by PicocSetResetPoint() */
+#endif
 
     /* types */    
     struct ValueType UberType;
@@ -437,6 +565,13 @@ struct Picoc_Struct
     struct ValueType *CharPtrPtrType;
     struct ValueType *CharArrayType;
     struct ValueType *VoidPtrType;
+    struct ValueType **TypeHashTable;   /* intern table of all types keyed by parent, base, array size and identifier */
+    int TypeHashSize;
+    int TypeHashCount;
+    int IntAlignBytes;
+    int PointerAlignBytes;
+    char StructTempName[7];             /* the last name made up for an anonymous struct */
+    char EnumTempName[7];               /* the last name made up for an anonymous enum */
 
     /* debugger */
     struct Table BreakpointTable;
@@ -450,6 +585,12 @@ struct Picoc_Struct
 
     IOFILE *CStdOut;
     IOFILE CStdOutBase;
+#ifndef BUILTIN_MINI_STDLIB
+    FILE *StdinValue;                   /* stdin, stdout and stderr as seen by programs */
+    FILE *StdoutValue;
+    FILE *StderrValue;
+    char *StrtokState;                  /* where strtok() got up to */
+#endif
 
     /* the picoc version string */
     const char *VersionString;
@@ -467,6 +608,18 @@ struct Picoc_Struct
     struct TableEntry *StringHashTable[STRING_TABLE_SIZE];
     char *StrEmpty;
 
+    /* the files the trace and the program's output are written to */
+    char *TraceFile;
+    char *TraceStdoutFile;
+    
+    /* or they can be captured in memory instead */
+    FILE *TraceStream;                  /* the trace goes here rather than to TraceFile if it's set */
+    char *TraceBuffer;                  /* what's been written to TraceStream */
+    size_t TraceSize;
+    char *OutputBuffer;                 /* what the program has written to StdoutValue */
+    size_t OutputSize;
+    FILE *ErrorStream;                  /* where errors are reported for the trace, stderr if it's not set */
+
     /* Malloc allocation table */
     int TotalMallocs;
     unsigned long MallocInfo[MAX_MALLOCS][2];
@@ -482,6 +635,7 @@ int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char
 struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key);
 char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen);
 void TableStrFree(Picoc *pc);
+void TableFreeHashTable(Picoc *pc, struct Table *Tbl);
 
 /* lex.c */
 void LexInit(Picoc *pc);
@@ -492,6 +646,8 @@ enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value, int I
 enum LexToken LexRawPeekToken(struct ParseState *Parser);
 void LexToEndOfLine(struct ParseState *Parser);
 void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser);
+void LexMacroTemplate(struct MacroDef *MDef);
+void LexFoldConstants(Picoc *pc, struct FuncDef *FuncDef);
 void LexInteractiveClear(Picoc *pc, struct ParseState *Parser);
 void LexInteractiveCompleted(Picoc *pc, struct ParseState *Parser);
 void LexInteractiveStatementPrompt(Picoc *pc);
@@ -504,6 +660,7 @@ void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger);
 enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemicolon);
 struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueType *ReturnType, char *Identifier);
 void ParseCleanup(Picoc *pc);
+void ParseFreeInitialiserImages(Picoc *pc);
 void ParserCopyPos(struct ParseState *To, struct ParseState *From);
 void ParserCopy(struct ParseState *To, struct ParseState *From);
 
@@ -527,6 +684,7 @@ int TypeLastAccessibleOffset(Picoc *pc, struct Value *Val);
 int TypeParseFront(struct ParseState *Parser, struct ValueType **Typ, int *IsStatic);
 void TypeParseIdentPart(struct ParseState *Parser, struct ValueType *BasicTyp, struct ValueType **Typ, char **Identifier);
 void TypeParse(struct ParseState *Parser, struct ValueType **Typ, char **Identifier, int *IsStatic);
+struct ValueType *TypeLookup(Picoc *pc, struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier);
 struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser, struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier, int AllowDuplicates);
 struct ValueType *TypeCreateOpaqueStruct(Picoc *pc, struct ParseState *Parser, const char *StructName, int Size);
 int TypeIsForwardDeclared(struct ParseState *Parser, struct ValueType *Typ);
@@ -535,12 +693,20 @@ int TypeIsForwardDeclared(struct ParseState *Parser, struct ValueType *Typ);
 void HeapInit(Picoc *pc, int StackSize);
 void HeapCleanup(Picoc *pc);
 void *HeapAllocStack(Picoc *pc, int Size);
+void *HeapAllocStackUninitialised(Picoc *pc, int Size);
 int HeapPopStack(Picoc *pc, void *Addr, int Size);
 void HeapUnpopStack(Picoc *pc, int Size);
 void HeapPushStackFrame(Picoc *pc);
 int HeapPopStackFrame(Picoc *pc);
 void *HeapAllocMem(Picoc *pc, int Size);
+void *HeapAllocMemUninitialised(Picoc *pc, int Size);
 void HeapFreeMem(Picoc *pc, void *Mem);
+#ifndef USE_MALLOC_HEAP
+void HeapGetStats(Picoc *pc, struct HeapStats *Stats);
+#else
+void HeapSaveResetPoint(Picoc *pc);
+void HeapRestoreResetPoint(Picoc *pc);
+#endif
 
 /* variable.c */
 void VariableInit(Picoc *pc);
@@ -548,6 +714,7 @@ void VariableCleanup(Picoc *pc);
 void VariableFree(Picoc *pc, struct Value *Val);
 void VariableTableCleanup(Picoc *pc, struct Table *HashTable);
 void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap);
+void *VariableAllocUninitialised(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap);
 void VariableStackPop(struct ParseState *Parser, struct Value *Var);
 struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser, int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap);
 struct Value *VariableAllocValueAndCopy(Picoc *pc, struct ParseState *Parser, struct Value *FromValue, int OnHeap);
@@ -573,6 +740,7 @@ void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int PrevScopeID);
 void BasicIOInit(Picoc *pc);
 void LibraryInit(Picoc *pc);
 void LibraryAdd(Picoc *pc, struct Table *GlobalTable, const char *LibraryName, struct LibraryFunction *FuncList);
+struct Value *LibraryResolve(Picoc *pc, const char *Identifier, struct Value *FuncValue);
 void CLibraryInit(Picoc *pc);
 void PrintCh(char OutCh, IOFILE *Stream);
 void PrintSimpleInt(long Num, IOFILE *Stream);
@@ -596,12 +764,16 @@ void AssignFail(struct ParseState *Parser, const char *Format, struct ValueType
 void LexFail(Picoc *pc, struct LexState *Lexer, const char *Message, ...);
 void PlatformInit(Picoc *pc);
 void PlatformCleanup(Picoc *pc);
+void PlatformStackInit(Picoc *pc);
 char *PlatformGetLine(char *Buf, int MaxLen, const char *Prompt);
 int PlatformGetCharacter();
 void PlatformPutc(unsigned char OutCh, union OutputStreamInfo *);
 void PlatformPrintf(IOFILE *Stream, const char *Format, ...);
 void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args);
 void PlatformExit(Picoc *pc, int ExitVal);
+#ifdef USE_MALLOC_HEAP
+int PicocResetPointKeeps(Picoc *pc, void *Block);
+#endif
 char *PlatformMakeTempName(Picoc *pc, char *TempNameBuffer);
 void PlatformLibraryInit(Picoc *pc);
 
@@ -10,6 +10,7 @@
 #endif
 #define isCidstart(c) (isalpha(c) || (c)=='_' || (c)=='#')
 #define isCident(c) (isalnum(c) || (c)=='_')
+#define isblankspace(c) (isspace(c) && (c) != '\n')
 
 #define IS_HEX_ALPHA_DIGIT(c) (((c) >= 'a' && (c) <= 'f') || ((c) >= 'A' && (c) <= 'F'))
 #define IS_BASE_DIGIT(c,b) (((c) >= '0' && (c) < '0' + (((b)<10)?(b):10)) || (((b) > 10) ? IS_HEX_ALPHA_DIGIT(c) : FALSE))
@@ -23,9 +24,43 @@
 
 #define LEXER_INC(l) ( (l)->Pos++, (l)->CharacterPos++ )
 #define LEXER_INCN(l, n) ( (l)->Pos+=(n), (l)->CharacterPos+=(n) )
-#define TOKEN_DATA_OFFSET 2
+#define LEXER_SKIP_TO(l, p) ( (l)->CharacterPos += (p) - (l)->Pos, (l)->Pos = (p) )
+
+/* each token is stored as its token byte, the column it starts at as a varint, 
+ * then its value if it has one. integer constants store their value as a varint 
+ * too. a run of line ends is a single TokenEndOfLine with a varint count of the 
+ * lines instead of a column. TokenEOF and TokenEndOfFunction are just the token 
+ * byte. varints hold seven bits per byte, low bits first, with the top bit set 
+ * on every byte but the last */
+#define TOKEN_END_SIZE 1
+#define TOKEN_HAS_COLUMN(t) ((t) != TokenEndOfLine && (t) != TokenEOF && (t) != TokenEndOfFunction)
+#define VARINT_MAX_SIZE ((sizeof(unsigned long) * 8 + 6) / 7)
+#define VARINT_MORE 0x80
+#define MAX_LINES_PER_TOKEN 127     /* a line count which fits in a single varint byte */
 
 #define MAX_CHAR_VALUE 255      /* maximum value which can be represented by a "char" data type */
+#define FOLD_MACRO_DEPTH 8      /* how deeply nested macros can be and still get folded */
+
+#define IS_TYPE_KEYWORD_TOKEN(t) ((t) >= TokenIntType && (t) <= TokenTypedef)
+
+/* a folded constant's value - it's stored in the token stream after the constant's type */
+union FoldedData
+{
+    long LongInteger;
+#ifndef NO_FP
+    double FP;
+#endif
+};
+
+/* what we know while folding the constants in a function body */
+struct FoldState
+{
+    Picoc *pc;
+    char **Declared;            /* identifiers declared anywhere in the function */
+    int NumDeclared;
+    int UsesFP;                 /* a floating point constant was seen */
+    int UsesIntegerOp;          /* an operator which only works on integers was seen */
+};
 
 
 struct ReservedWord
@@ -34,7 +69,7 @@ struct ReservedWord
     enum LexToken Token;
 };
 
-static struct ReservedWord ReservedWords[] =
+static const struct ReservedWord ReservedWords[] =
 {
     { "#define", TokenHashDefine },
     { "#else", TokenHashElse },
@@ -53,12 +88,16 @@ static struct ReservedWord ReservedWords[] =
     { "do", TokenDo },
 #ifndef NO_FP
     { "double", TokenDoubleType },
+#else
+    { "double", TokenNone },
 #endif
     { "else", TokenElse },
     { "enum", TokenEnumType },
     { "extern", TokenExternType },
 #ifndef NO_FP
     { "float", TokenFloatType },
+#else
+    { "float", TokenNone },
 #endif
     { "for", TokenFor },
     { "goto", TokenGoto },
@@ -81,20 +120,31 @@ static struct ReservedWord ReservedWords[] =
     { "while", TokenWhile }
 };
 
+/* a perfect hash of the reserved words. no two of them hash to the same slot 
+ * so a word is a reserved word only if it's the one in its slot. each slot 
+ * holds one more than the index of its word in ReservedWords[], or 0 if it's 
+ * empty. the table has to be regenerated if ReservedWords[] changes */
+#define RESERVED_WORD_MIN_LEN 2
+#define RESERVED_WORD_MAX_LEN 8
+#define RESERVED_WORD_HASH(w,l) (((unsigned char)(w)[0] * 2 + (unsigned char)(w)[1] * 6 + (unsigned char)(w)[(l)-1] + (l) * 4) & 127)
+
+static const unsigned char ReservedWordSlot[128] =
+{
+    36, 10, 37,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0, 32,  0,  0,  0,  2,  0,  1,
+    19,  0,  3, 14, 23,  0,  0,  0,  0,  0, 33,  0,  0,  0,  4,  0,
+    34,  0,  0,  0,  0,  0, 13,  0, 11,  0,  5,  0,  0, 26,  6,  0,
+    35,  7,  0,  0,  0,  0,  0, 17, 28,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0, 27,  0,  0, 39, 30, 15, 31, 18, 20,  0, 29, 16,
+     0,  0,  0,  0, 21, 12, 24, 22,  0, 25,  0,  0,  0,  0,  0,  9,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 38,  0,  0,  0,  0,  8
+};
+
 
 
 /* initialise the lexer */
 void LexInit(Picoc *pc)
 {
-    int Count;
-    
-    TableInitTable(&pc->ReservedWordTable, &pc->ReservedWordHashTable[0], sizeof(ReservedWords) / sizeof(struct ReservedWord) * 2, TRUE);
-
-    for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord); Count++)
-    {
-        TableSet(pc, &pc->ReservedWordTable, TableStrRegister(pc, ReservedWords[Count].Word), (struct Value *)&ReservedWords[Count], NULL, 0, 0);
-    }
-    
     pc->LexValue.Typ = NULL;
     pc->LexValue.Val = &pc->LexAnyValue;
     pc->LexValue.LValueFrom = FALSE;
@@ -107,23 +157,28 @@ void LexInit(Picoc *pc)
 /* deallocate */
 void LexCleanup(Picoc *pc)
 {
-    int Count;
-
     LexInteractiveClear(pc, NULL);
-
-    for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord); Count++)
-        TableDelete(pc, &pc->ReservedWordTable, TableStrRegister(pc, ReservedWords[Count].Word));
 }
 
-/* check if a word is a reserved word - used while scanning */
-enum LexToken LexCheckReservedWord(Picoc *pc, const char *Word)
+/* check if a word is a reserved word - used while scanning. the word is 
+ * checked where it is in the source, before it's put in the string table */
+static enum LexToken LexCheckReservedWord(const char *Word, int Len)
 {
-    struct Value *val;
+    const struct ReservedWord *Reserved;
+    int Slot;
     
-    if (TableGet(&pc->ReservedWordTable, Word, &val, NULL, NULL, NULL))
-        return ((struct ReservedWord *)val)->Token;
-    else
+    if (Len < RESERVED_WORD_MIN_LEN || Len > RESERVED_WORD_MAX_LEN)
         return TokenNone;
+    
+    Slot = ReservedWordSlot[RESERVED_WORD_HASH(Word, Len)];
+    if (Slot == 0)
+        return TokenNone;
+    
+    Reserved = &ReservedWords[Slot-1];
+    if (strncmp(Reserved->Word, Word, Len) != 0 || Reserved->Word[Len] != '\0')
+        return TokenNone;
+        
+    return Reserved->Token;
 }
 
 /* get a numeric literal - used while scanning */
@@ -235,20 +290,133 @@ enum LexToken LexGetNumber(Picoc *pc, struct LexState *Lexer, struct Value *Valu
 #endif
 }
 
+#ifdef USE_SSE2_LEXER
+/* character classes of 16 characters at once. each gives a byte of all ones 
+ * for the characters which are in the class. characters above 127 compare as 
+ * negative so they're never in a range */
+#define LEX_SIMD_WIDTH 16
+#define LEX_SIMD_RANGE(v,lo,hi) _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((lo)-1)), _mm_cmplt_epi8((v), _mm_set1_epi8((hi)+1)))
+#define LEX_SIMD_IS(v,c) _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+
+static int LexSimdIdentMask(__m128i Chars)
+{
+    __m128i Ident = _mm_or_si128(LEX_SIMD_RANGE(Chars, 'a', 'z'), LEX_SIMD_RANGE(Chars, 'A', 'Z'));
+    Ident = _mm_or_si128(Ident, LEX_SIMD_RANGE(Chars, '0', '9'));
+    Ident = _mm_or_si128(Ident, LEX_SIMD_IS(Chars, '_'));
+    return _mm_movemask_epi8(Ident);
+}
+
+static int LexSimdBlankMask(__m128i Chars)
+{
+    /* ' ', '\t', '\v', '\f' and '\r' - everything isspace() takes except '\n' */
+    __m128i Blank = _mm_or_si128(LEX_SIMD_IS(Chars, ' '), LEX_SIMD_RANGE(Chars, '\t', '\r'));
+    return _mm_movemask_epi8(_mm_andnot_si128(LEX_SIMD_IS(Chars, '\n'), Blank));
+}
+#endif
+
+/* find the end of a run of identifier characters */
+static const char *LexSkipIdentChars(const char *Pos, const char *End)
+{
+#ifdef USE_SSE2_LEXER
+    while (End - Pos >= LEX_SIMD_WIDTH && isCident((int)*Pos))
+    {
+        int Mask = ~LexSimdIdentMask(_mm_loadu_si128((const __m128i *)Pos)) & 0xffff;
+        if (Mask != 0)
+            return Pos + __builtin_ctz(Mask);
+            
+        Pos += LEX_SIMD_WIDTH;
+    }
+#endif
+    while (Pos != End && isCident((int)*Pos))
+        Pos++;
+        
+    return Pos;
+}
+
+/* find the end of a run of white space on a line */
+static const char *LexSkipBlanks(const char *Pos, const char *End)
+{
+#ifdef USE_SSE2_LEXER
+    while (End - Pos >= LEX_SIMD_WIDTH && isblankspace((int)*Pos))
+    {
+        int Mask = ~LexSimdBlankMask(_mm_loadu_si128((const __m128i *)Pos)) & 0xffff;
+        if (Mask != 0)
+            return Pos + __builtin_ctz(Mask);
+            
+        Pos += LEX_SIMD_WIDTH;
+    }
+#endif
+    while (Pos != End && isblankspace((int)*Pos))
+        Pos++;
+        
+    return Pos;
+}
+
+/* find the next end character or backslash in a string constant */
+static const char *LexSkipStringChars(const char *Pos, const char *End, char EndChar)
+{
+#ifdef USE_SSE2_LEXER
+    while (End - Pos >= LEX_SIMD_WIDTH)
+    {
+        __m128i Chars = _mm_loadu_si128((const __m128i *)Pos);
+        int Mask = _mm_movemask_epi8(_mm_or_si128(LEX_SIMD_IS(Chars, EndChar), LEX_SIMD_IS(Chars, '\\')));
+        if (Mask != 0)
+            return Pos + __builtin_ctz(Mask);
+            
+        Pos += LEX_SIMD_WIDTH;
+    }
+#endif
+    while (Pos != End && *Pos != EndChar && *Pos != '\\')
+        Pos++;
+        
+    return Pos;
+}
+
+/* find the end of a conventional C comment. that's a '/' just after a '*', 
+ * where the character before Pos counts too. also counts the newlines skipped */
+static const char *LexFindCommentEnd(const char *Pos, const char *End, int *Newlines)
+{
+#ifdef USE_SSE2_LEXER
+    while (End - Pos >= LEX_SIMD_WIDTH)
+    {
+        __m128i Chars = _mm_loadu_si128((const __m128i *)Pos);
+        __m128i Before = _mm_loadu_si128((const __m128i *)(Pos-1));
+        int Mask = _mm_movemask_epi8(_mm_and_si128(LEX_SIMD_IS(Before, '*'), LEX_SIMD_IS(Chars, '/')));
+        int NewlineMask = _mm_movemask_epi8(LEX_SIMD_IS(Chars, '\n'));
+        
+        if (Mask != 0)
+        {
+            int Found = __builtin_ctz(Mask);
+            *Newlines += __builtin_popcount(NewlineMask & ((1 << Found) - 1));
+            return Pos + Found;
+        }
+        
+        *Newlines += __builtin_popcount(NewlineMask);
+        Pos += LEX_SIMD_WIDTH;
+    }
+#endif
+    while (Pos != End && (*(Pos-1) != '*' || *Pos != '/'))
+    {
+        if (*Pos == '\n')
+            (*Newlines)++;
+            
+        Pos++;
+    }
+    
+    return Pos;
+}
+
 /* get a reserved word or identifier - used while scanning */
 enum LexToken LexGetWord(Picoc *pc, struct LexState *Lexer, struct Value *Value)
 {
     const char *StartPos = Lexer->Pos;
+    const char *WordEnd = LexSkipIdentChars(Lexer->Pos+1, Lexer->End);
     enum LexToken Token;
     
-    do {
-        LEXER_INC(Lexer);
-    } while (Lexer->Pos != Lexer->End && isCident((int)*Lexer->Pos));
+    LEXER_SKIP_TO(Lexer, WordEnd);
     
     Value->Typ = NULL;
-    Value->Val->Identifier = TableStrRegister2(pc, StartPos, Lexer->Pos - StartPos);
-    
-    Token = LexCheckReservedWord(pc, Value->Val->Identifier);
+    Token = LexCheckReservedWord(StartPos, Lexer->Pos - StartPos);
     switch (Token)
     {
         case TokenHashInclude: Lexer->Mode = LexModeHashInclude; break;
@@ -259,6 +427,7 @@ enum LexToken LexGetWord(Picoc *pc, struct LexState *Lexer, struct Value *Value)
     if (Token != TokenNone)
         return Token;
     
+    Value->Val->Identifier = TableStrRegister2(pc, StartPos, Lexer->Pos - StartPos);
     if (Lexer->Mode == LexModeHashDefineSpace)
         Lexer->Mode = LexModeHashDefineSpaceIdent;
     
@@ -335,6 +504,14 @@ enum LexToken LexGetStringConstant(Picoc *pc, struct LexState *Lexer, struct Val
     while (Lexer->Pos != Lexer->End && (*Lexer->Pos != EndChar || Escape))
     { 
         /* find the end */
+        if (!Escape && *Lexer->Pos != '\\')
+        {
+            /* skip ordinary characters up to the next end character or escape */
+            const char *RunEnd = LexSkipStringChars(Lexer->Pos, Lexer->End, EndChar);
+            LEXER_SKIP_TO(Lexer, RunEnd);
+            continue;
+        }
+        
         if (Escape)
         {
             if (*Lexer->Pos == '\r' && Lexer->Pos+1 != Lexer->End)
@@ -357,7 +534,7 @@ enum LexToken LexGetStringConstant(Picoc *pc, struct LexState *Lexer, struct Val
     }
     EndPos = Lexer->Pos;
     
-    EscBuf = HeapAllocStack(pc, EndPos - StartPos);
+    EscBuf = HeapAllocStackUninitialised(pc, EndPos - StartPos);
     if (EscBuf == NULL)
         LexFail(pc, Lexer, "out of memory");
     
@@ -404,13 +581,8 @@ void LexSkipComment(struct LexState *Lexer, char NextChar, enum LexToken *Return
     if (NextChar == '*')
     {   
         /* conventional C comment */
-        while (Lexer->Pos != Lexer->End && (*(Lexer->Pos-1) != '*' || *Lexer->Pos != '/'))
-        {
-            if (*Lexer->Pos == '\n')
-                Lexer->EmitExtraNewlines++;
-
-            LEXER_INC(Lexer);
-        }
+        const char *CommentEnd = LexFindCommentEnd(Lexer->Pos, Lexer->End, &Lexer->EmitExtraNewlines);
+        LEXER_SKIP_TO(Lexer, CommentEnd);
         
         if (Lexer->Pos != Lexer->End)
             LEXER_INC(Lexer);
@@ -420,8 +592,11 @@ void LexSkipComment(struct LexState *Lexer, char NextChar, enum LexToken *Return
     else
     {   
         /* C++ style comment */
-        while (Lexer->Pos != Lexer->End && *Lexer->Pos != '\n')
-            LEXER_INC(Lexer);
+        const char *LineEnd = memchr(Lexer->Pos, '\n', Lexer->End - Lexer->Pos);
+        if (LineEnd == NULL)
+            LineEnd = Lexer->End;
+            
+        LEXER_SKIP_TO(Lexer, LineEnd);
     }
 }
 
@@ -430,6 +605,7 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer, struct Value **
 {
     char ThisChar;
     char NextChar;
+    const char *BlankEnd;
     enum LexToken GotToken = TokenNone;
     
     /* handle cases line multi-line comments or string constants which mess up the line count */
@@ -459,7 +635,9 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer, struct Value **
             else if (Lexer->Mode == LexModeHashDefineSpaceIdent)
                 Lexer->Mode = LexModeNormal;
     
-            LEXER_INC(Lexer);
+            /* the mode changes above are the same for the rest of the run */
+            BlankEnd = LexSkipBlanks(Lexer->Pos+1, Lexer->End);
+            LEXER_SKIP_TO(Lexer, BlankEnd);
         }
         
         if (Lexer->Pos == Lexer->End || *Lexer->Pos == '\0')
@@ -514,14 +692,74 @@ int LexTokenSize(enum LexToken Token)
 {
     switch (Token)
     {
-        case TokenIdentifier: case TokenStringConstant: return sizeof(char *);
+        case TokenIdentifier: case TokenStringConstant: case TokenMacroParameter: return sizeof(char *);
         case TokenIntegerConstant: return sizeof(long);
         case TokenCharacterConstant: return sizeof(unsigned char);
         case TokenFPConstant: return sizeof(double);
+        case TokenFoldedConstant: return sizeof(struct ValueType *) + sizeof(union FoldedData);
         default: return 0;
     }
 }
 
+/* write a varint, returning where it ends */
+static unsigned char *LexPutVarint(unsigned char *Pos, unsigned long Value)
+{
+    while (Value >= VARINT_MORE)
+    {
+        *Pos++ = (unsigned char)(Value | VARINT_MORE);
+        Value >>= 7;
+    }
+    
+    *Pos++ = (unsigned char)Value;
+    return Pos;
+}
+
+/* read a varint, returning where it ends */
+static const unsigned char *LexGetVarint(const unsigned char *Pos, unsigned long *Value)
+{
+    unsigned long Result = 0;
+    int Shift = 0;
+    
+    while (*Pos & VARINT_MORE)
+    {
+        Result |= (unsigned long)(*Pos++ & ~VARINT_MORE) << Shift;
+        Shift += 7;
+    }
+    
+    *Value = Result | ((unsigned long)*Pos++ << Shift);
+    return Pos;
+}
+
+/* skip a varint */
+static const unsigned char *LexSkipVarint(const unsigned char *Pos)
+{
+    while (*Pos++ & VARINT_MORE)
+    {}
+    
+    return Pos;
+}
+
+/* where the value of the token at this position starts */
+static const unsigned char *LexTokenValue(const unsigned char *Pos)
+{
+    if (*Pos == TokenEOF || *Pos == TokenEndOfFunction)
+        return Pos + TOKEN_END_SIZE;
+        
+    return LexSkipVarint(Pos + 1);
+}
+
+/* where the token after the one at this position starts */
+static const unsigned char *LexNextToken(const unsigned char *Pos)
+{
+    enum LexToken Token = (enum LexToken)*Pos;
+    
+    Pos = LexTokenValue(Pos);
+    if (Token == TokenIntegerConstant)
+        return LexSkipVarint(Pos);
+        
+    return Pos + LexTokenSize(Token);
+}
+
 /* produce tokens from the lexer and return a heap buffer with the result - used for scanning */
 void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
 {
@@ -530,50 +768,81 @@ void *LexTokenise(Picoc *pc, struct LexState *Lexer, int *TokenLen)
     struct Value *GotValue;
     int MemUsed = 0;
     int ValueSize;
-    int ReserveSpace = (Lexer->End - Lexer->Pos) * 4 + 16; 
-    void *TokenSpace = HeapAllocStack(pc, ReserveSpace);
-    char *TokenPos = (char *)TokenSpace;
+    int ReserveSpace = (Lexer->End - Lexer->Pos) * 2 + 16; 
+    unsigned char *TokenSpace = HeapAllocMemUninitialised(pc, ReserveSpace);
+    unsigned char *NewSpace;
+    unsigned char *TokenPos;
     int LastCharacterPos = 0;
+    int LineEndStart = -1;
 
     if (TokenSpace == NULL)
         LexFail(pc, Lexer, "out of memory");
     
     do
     { 
-        /* store the token at the end of the stack area */
         Token = LexScanGetToken(pc, Lexer, &GotValue);
 
 #ifdef DEBUG_LEXER
         printf("Token: %02x\n", Token);
 #endif
-        *(unsigned char *)TokenPos = Token;
-        TokenPos++;
-        MemUsed++;
-
-        *(unsigned char *)TokenPos = (unsigned char)LastCharacterPos;
-        TokenPos++;
-        MemUsed++;
-
         ValueSize = LexTokenSize(Token);
-        if (ValueSize > 0)
-        { 
-            /* store a value as well */
-            memcpy((void *)TokenPos, (void *)GotValue->Val, ValueSize);
-            TokenPos += ValueSize;
-            MemUsed += ValueSize;
+        if (MemUsed + 1 + VARINT_MAX_SIZE * 2 + ValueSize > ReserveSpace)
+        {
+            /* the scratch buffer's full - make it bigger */
+            ReserveSpace *= 2;
+            NewSpace = HeapAllocMemUninitialised(pc, ReserveSpace);
+            if (NewSpace == NULL)
+                LexFail(pc, Lexer, "out of memory");
+                
+            memcpy((void *)NewSpace, (void *)TokenSpace, MemUsed);
+            HeapFreeMem(pc, TokenSpace);
+            TokenSpace = NewSpace;
+        }
+        
+        if (Token == TokenEndOfLine)
+        {
+            /* add this line to the line end token just before it if there is one */
+            if (LineEndStart >= 0 && TokenSpace[LineEndStart+1] < MAX_LINES_PER_TOKEN)
+                TokenSpace[LineEndStart+1]++;
+            else
+            {
+                LineEndStart = MemUsed;
+                TokenSpace[MemUsed++] = (unsigned char)Token;
+                TokenSpace[MemUsed++] = 1;
+            }
+        }
+        else
+        {
+            /* store the token at the end of the scratch buffer */
+            TokenPos = &TokenSpace[MemUsed];
+            *TokenPos++ = (unsigned char)Token;
+            if (TOKEN_HAS_COLUMN(Token))
+                TokenPos = LexPutVarint(TokenPos, LastCharacterPos);
+                
+            if (Token == TokenIntegerConstant)
+                TokenPos = LexPutVarint(TokenPos, (unsigned long)GotValue->Val->LongInteger);
+                
+            else if (ValueSize > 0)
+            { 
+                /* store a value as well */
+                memcpy((void *)TokenPos, (void *)GotValue->Val, ValueSize);
+                TokenPos += ValueSize;
+            }
+            
+            MemUsed = TokenPos - TokenSpace;
+            LineEndStart = -1;
         }
     
         LastCharacterPos = Lexer->CharacterPos;
                     
     } while (Token != TokenEOF);
     
-    HeapMem = HeapAllocMem(pc, MemUsed);
+    HeapMem = HeapAllocMemUninitialised(pc, MemUsed);
     if (HeapMem == NULL)
         LexFail(pc, Lexer, "out of memory");
         
-    assert(ReserveSpace >= MemUsed);
-    memcpy(HeapMem, TokenSpace, MemUsed);
-    HeapPopStack(pc, TokenSpace, ReserveSpace);
+    memcpy(HeapMem, (void *)TokenSpace, MemUsed);
+    HeapFreeMem(pc, TokenSpace);
 #ifdef DEBUG_LEXER
     {
         int Count;
@@ -620,6 +889,8 @@ void LexInitParser(struct ParseState *Parser, Picoc *pc, const char *SourceText,
     Parser->CharacterPos = 0;
     Parser->SourceText = SourceText;
     Parser->DebugMode = EnableDebugger;
+    Parser->MacroArgs = NULL;
+    Parser->ScopeID = SCOPE_ID_TOP_LEVEL;
 }
 
 /* get the next token, without pre-processing */
@@ -627,6 +898,8 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
 {
     enum LexToken Token = TokenNone;
     int ValueSize;
+    const unsigned char *ValuePos;
+    unsigned long Number;
     char *Prompt = NULL;
     Picoc *pc = Parser->pc;
     
@@ -641,8 +914,8 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
             /* skip leading newlines */
             while ((Token = (enum LexToken)*(unsigned char *)Parser->Pos) == TokenEndOfLine)
             {
-                Parser->Line++;
-                Parser->Pos += TOKEN_DATA_OFFSET;
+                Parser->Pos = LexGetVarint(Parser->Pos + 1, &Number);
+                Parser->Line += Number;
             }
         }
     
@@ -654,7 +927,7 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
             int LineBytes;
             struct TokenLine *LineNode;
             
-            if (pc->InteractiveHead == NULL || (unsigned char *)Parser->Pos == &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumBytes-TOKEN_DATA_OFFSET])
+            if (pc->InteractiveHead == NULL || (unsigned char *)Parser->Pos == &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumBytes-TOKEN_END_SIZE])
             { 
                 /* get interactive input */
                 if (pc->LexUseStatementPrompt)
@@ -690,10 +963,10 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
             else
             { 
                 /* go to the next token line */
-                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET])
+                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_END_SIZE])
                 { 
                     /* scan for the line */
-                    for (pc->InteractiveCurrentLine = pc->InteractiveHead; Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET]; pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next)
+                    for (pc->InteractiveCurrentLine = pc->InteractiveHead; Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_END_SIZE]; pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next)
                     { assert(pc->InteractiveCurrentLine->Next != NULL); }
                 }
 
@@ -707,7 +980,20 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
         }
     } while ((Parser->FileName == pc->StrEmpty && Token == TokenEOF) || Token == TokenEndOfLine);
 
-    Parser->CharacterPos = *((unsigned char *)Parser->Pos + 1);
+    if (!TOKEN_HAS_COLUMN(Token))
+        ValuePos = Parser->Pos + TOKEN_END_SIZE;
+    else if (Parser->Pos[1] < VARINT_MORE)
+    {
+        /* nearly every column fits in one byte */
+        Parser->CharacterPos = Parser->Pos[1];
+        ValuePos = Parser->Pos + 2;
+    }
+    else
+    {
+        ValuePos = LexGetVarint(Parser->Pos + 1, &Number);
+        Parser->CharacterPos = (short int)Number;
+    }
+    
     ValueSize = LexTokenSize(Token);
     if (ValueSize > 0)
     { 
@@ -720,13 +1006,27 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
                 case TokenIdentifier:           pc->LexValue.Typ = NULL; break;
                 case TokenIntegerConstant:      pc->LexValue.Typ = &pc->LongType; break;
                 case TokenCharacterConstant:    pc->LexValue.Typ = &pc->CharType; break;
+                case TokenMacroParameter:       pc->LexValue.Typ = &pc->IntType; break;
 #ifndef NO_FP
                 case TokenFPConstant:           pc->LexValue.Typ = &pc->FPType; break;
 #endif
                 default: break;
             }
             
-            memcpy((void *)pc->LexValue.Val, (void *)((char *)Parser->Pos + TOKEN_DATA_OFFSET), ValueSize);
+            if (Token == TokenFoldedConstant)
+            {
+                /* folded constants carry their own type */
+                memcpy((void *)&pc->LexValue.Typ, (void *)ValuePos, sizeof(struct ValueType *));
+                memcpy((void *)pc->LexValue.Val, (void *)(ValuePos + sizeof(struct ValueType *)), sizeof(union FoldedData));
+            }
+            else if (Token == TokenIntegerConstant)
+            {
+                LexGetVarint(ValuePos, &Number);
+                pc->LexValue.Val->LongInteger = (long)Number;
+            }
+            else
+                memcpy((void *)pc->LexValue.Val, (void *)ValuePos, ValueSize);
+            
             pc->LexValue.ValOnHeap = FALSE;
             pc->LexValue.ValOnStack = FALSE;
             pc->LexValue.IsLValue = FALSE;
@@ -735,12 +1035,12 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value, in
         }
         
         if (IncPos)
-            Parser->Pos += ValueSize + TOKEN_DATA_OFFSET;
+            Parser->Pos = (Token == TokenIntegerConstant) ? LexSkipVarint(ValuePos) : ValuePos + ValueSize;
     }
     else
     {
         if (IncPos && Token != TokenEOF)
-            Parser->Pos += TOKEN_DATA_OFFSET;
+            Parser->Pos = ValuePos;
     }
     
 #ifdef DEBUG_LEXER
@@ -864,16 +1164,16 @@ void LexPrintToken(enum LexToken Token)
         /* 0x21 */ "Increment", "Decrement", "UnaryNot", "UnaryExor", "Sizeof", "Cast",
         /* 0x27 */ "LeftSquareBracket", "RightSquareBracket", "Dot", "Arrow", 
         /* 0x2b */ "OpenBracket", "CloseBracket",
-        /* 0x2d */ "Identifier", "IntegerConstant", "FPConstant", "StringConstant", "CharacterConstant",
-        /* 0x32 */ "Semicolon", "Ellipsis",
-        /* 0x34 */ "LeftBrace", "RightBrace",
-        /* 0x36 */ "IntType", "CharType", "FloatType", "DoubleType", "VoidType", "EnumType",
-        /* 0x3c */ "LongType", "SignedType", "ShortType", "StaticType", "AutoType", "RegisterType", "ExternType", "StructType", "UnionType", "UnsignedType", "Typedef",
-        /* 0x46 */ "Continue", "Do", "Else", "For", "Goto", "If", "While", "Break", "Switch", "Case", "Default", "Return",
-        /* 0x52 */ "HashDefine", "HashInclude", "HashIf", "HashIfdef", "HashIfndef", "HashElse", "HashEndif",
-        /* 0x59 */ "New", "Delete",
-        /* 0x5b */ "OpenMacroBracket",
-        /* 0x5c */ "EOF", "EndOfLine", "EndOfFunction"
+        /* 0x2d */ "Identifier", "IntegerConstant", "FPConstant", "StringConstant", "CharacterConstant", "FoldedConstant",
+        /* 0x33 */ "Semicolon", "Ellipsis",
+        /* 0x35 */ "LeftBrace", "RightBrace",
+        /* 0x37 */ "IntType", "CharType", "FloatType", "DoubleType", "VoidType", "EnumType",
+        /* 0x3d */ "LongType", "SignedType", "ShortType", "StaticType", "AutoType", "RegisterType", "ExternType", "StructType", "UnionType", "UnsignedType", "Typedef",
+        /* 0x47 */ "Continue", "Do", "Else", "For", "Goto", "If", "While", "Break", "Switch", "Case", "Default", "Return",
+        /* 0x53 */ "HashDefine", "HashInclude", "HashIf", "HashIfdef", "HashIfndef", "HashElse", "HashEndif",
+        /* 0x5a */ "New", "Delete",
+        /* 0x5c */ "OpenMacroBracket", "MacroParameter",
+        /* 0x5e */ "EOF", "EndOfLine", "EndOfFunction"
     };
     printf("{%s}", TokenNames[Token]);
 }
@@ -945,7 +1245,7 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     { 
         /* non-interactive mode - copy the tokens */
         MemSize = EndParser->Pos - StartParser->Pos;
-        NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE);
+        NewTokens = VariableAllocUninitialised(pc, StartParser, MemSize + TOKEN_END_SIZE, TRUE);
         memcpy(NewTokens, (void *)StartParser->Pos, MemSize);
     }
     else
@@ -958,28 +1258,28 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
         { 
             /* all on a single line */
             MemSize = EndParser->Pos - StartParser->Pos;
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE);
+            NewTokens = VariableAllocUninitialised(pc, StartParser, MemSize + TOKEN_END_SIZE, TRUE);
             memcpy(NewTokens, (void *)StartParser->Pos, MemSize);
         }
         else
         { 
             /* it's spread across multiple lines */
-            MemSize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
+            MemSize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_END_SIZE] - Pos;
 
             for (ILine = pc->InteractiveCurrentLine->Next; ILine != NULL && (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]); ILine = ILine->Next)
-                MemSize += ILine->NumBytes - TOKEN_DATA_OFFSET;
+                MemSize += ILine->NumBytes - TOKEN_END_SIZE;
             
             assert(ILine != NULL);
             MemSize += EndParser->Pos - &ILine->Tokens[0];
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, TRUE);
+            NewTokens = VariableAllocUninitialised(pc, StartParser, MemSize + TOKEN_END_SIZE, TRUE);
             
-            CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
+            CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_END_SIZE] - Pos;
             memcpy(NewTokens, Pos, CopySize);
             NewTokenPos = NewTokens + CopySize;
             for (ILine = pc->InteractiveCurrentLine->Next; ILine != NULL && (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]); ILine = ILine->Next)
             {
-                memcpy(NewTokenPos, &ILine->Tokens[0], ILine->NumBytes - TOKEN_DATA_OFFSET);
-                NewTokenPos += ILine->NumBytes-TOKEN_DATA_OFFSET;
+                memcpy(NewTokenPos, &ILine->Tokens[0], ILine->NumBytes - TOKEN_END_SIZE);
+                NewTokenPos += ILine->NumBytes-TOKEN_END_SIZE;
             }
             assert(ILine != NULL);
             memcpy(NewTokenPos, &ILine->Tokens[0], EndParser->Pos - &ILine->Tokens[0]);
@@ -987,10 +1287,605 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     }
     
     NewTokens[MemSize] = (unsigned char)TokenEndOfFunction;
-        
+    
     return NewTokens;
 }
 
+/* replace the parameters in a macro body with TokenMacroParameter tokens giving the 
+ * argument number, so a call can bind its arguments without making a stack frame to 
+ * look them up in. a parameter which is used as a function name needs a real 
+ * variable so bodies like that are left alone */
+void LexMacroTemplate(struct MacroDef *MDef)
+{
+    unsigned char *Pos;
+    unsigned char *ValuePos;
+    enum LexToken Token;
+    enum LexToken PrevToken;
+    const char *Identifier;
+    int Rewrite;
+    int Count;
+    
+    for (Rewrite = FALSE; Rewrite <= TRUE; Rewrite++)
+    {
+        PrevToken = TokenNone;
+        for (Pos = (unsigned char *)MDef->Body.Pos; (Token = (enum LexToken)*Pos) != TokenEndOfFunction; Pos = (unsigned char *)LexNextToken(Pos))
+        {
+            if (Token == TokenIdentifier && PrevToken != TokenDot && PrevToken != TokenArrow)
+            {
+                /* is it one of the parameters? */
+                ValuePos = (unsigned char *)LexTokenValue(Pos);
+                memcpy((void *)&Identifier, (void *)ValuePos, sizeof(Identifier));
+                for (Count = 0; Count < MDef->NumParams && MDef->ParamName[Count] != Identifier; Count++)
+                {}
+                
+                if (Count < MDef->NumParams)
+                {
+                    if (!Rewrite && ValuePos[sizeof(char *)] == TokenOpenBracket)
+                        return;
+                    
+                    if (Rewrite)
+                    {
+                        Pos[0] = (unsigned char)TokenMacroParameter;
+                        memset((void *)ValuePos, '\0', sizeof(char *));
+                        memcpy((void *)ValuePos, (void *)&Count, sizeof(int));
+                        Token = TokenMacroParameter;
+                    }
+                }
+            }
+            
+            PrevToken = Token;
+        }
+    }
+    
+    MDef->IsTemplate = TRUE;
+}
+
+/* get the token at a position in a token buffer, and where the token after it starts */
+static enum LexToken LexFoldGetToken(const unsigned char *Pos, const unsigned char **Next)
+{
+    enum LexToken Token = (enum LexToken)*Pos;
+    
+    if (Next != NULL)
+        *Next = LexNextToken(Pos);
+        
+    return Token;
+}
+
+/* get the identifier which goes with an identifier token */
+static char *LexFoldGetIdentifier(const unsigned char *Pos)
+{
+    char *Identifier;
+    
+    memcpy((void *)&Identifier, (void *)LexTokenValue(Pos), sizeof(char *));
+    return Identifier;
+}
+
+/* get the first token after any line ends */
+static enum LexToken LexFoldPeekToken(const unsigned char *Pos)
+{
+    while (*Pos == TokenEndOfLine)
+        Pos = LexNextToken(Pos);
+        
+    return (enum LexToken)*Pos;
+}
+
+/* is this token a literal which isn't zero? */
+static int LexFoldIsNonZeroLiteral(const unsigned char *Pos)
+{
+    unsigned long IntValue;
+#ifndef NO_FP
+    double FPValue;
+#endif
+    
+    switch (*Pos)
+    {
+        case TokenIntegerConstant:
+            LexGetVarint(LexTokenValue(Pos), &IntValue);
+            return IntValue != 0;
+            
+        case TokenCharacterConstant:
+            return *LexTokenValue(Pos) != 0;
+#ifndef NO_FP
+        case TokenFPConstant:
+            memcpy((void *)&FPValue, (void *)LexTokenValue(Pos), sizeof(double));
+            return FPValue != 0.0;
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+/* get a global which isn't hidden by a declaration in the function, or NULL */
+static struct Value *LexFoldGetGlobal(struct FoldState *Fold, const char *Identifier)
+{
+    struct Value *Val;
+    int Count;
+    
+    for (Count = 0; Count < Fold->NumDeclared; Count++)
+    {
+        if (Fold->Declared[Count] == Identifier)
+            return NULL;
+    }
+    
+    if (!TableGet(&Fold->pc->GlobalTable, Identifier, &Val, NULL, NULL, NULL))
+        return NULL;
+        
+    return Val;
+}
+
+/* find the identifiers declared anywhere in a function body. these hide any global
+ * macros or enum constants of the same name so they can't be folded. it doesn't
+ * matter if we find too many */
+static void LexFoldFindDeclarations(struct FoldState *Fold, const unsigned char *Pos)
+{
+    enum LexToken Token;
+    enum LexToken PrevToken = TokenNone;
+    const unsigned char *Next;
+    struct Value *Val;
+    int InDeclaration = FALSE;
+    int InInitialiser = FALSE;
+    int BracketDepth = 0;
+    
+    while ((Token = LexFoldGetToken(Pos, &Next)) != TokenEndOfFunction)
+    {
+        if (IS_TYPE_KEYWORD_TOKEN(Token))
+        {
+            if (!InDeclaration)
+            {
+                InDeclaration = TRUE;
+                InInitialiser = FALSE;
+                BracketDepth = 0;
+            }
+            
+            /* skip over struct, union and enum names */
+            if ((Token == TokenStructType || Token == TokenUnionType || Token == TokenEnumType) && LexFoldGetToken(Next, NULL) == TokenIdentifier)
+                LexFoldGetToken(Next, &Next);
+        }
+        else if (Token == TokenIdentifier)
+        {
+            char *Identifier = LexFoldGetIdentifier(Pos);
+            
+            if (InDeclaration && !InInitialiser && (IS_TYPE_KEYWORD_TOKEN(PrevToken) || PrevToken == TokenAsterisk || PrevToken == TokenComma || PrevToken == TokenOpenBracket || PrevToken == TokenIdentifier))
+                Fold->Declared[Fold->NumDeclared++] = Identifier;
+            
+            else if (!InDeclaration && TableGet(&Fold->pc->GlobalTable, Identifier, &Val, NULL, NULL, NULL) && Val->Typ->Base == Type_Type)
+            {
+                /* a typedef name starts a declaration */
+                InDeclaration = TRUE;
+                InInitialiser = FALSE;
+                BracketDepth = 0;
+            }
+        }
+        else if (InDeclaration)
+        {
+            switch (Token)
+            {
+                case TokenOpenBracket: case TokenLeftSquareBracket:
+                    BracketDepth++;
+                    break;
+                    
+                case TokenCloseBracket: case TokenRightSquareBracket:
+                    if (BracketDepth == 0)
+                        InDeclaration = FALSE;      /* the end of a cast or a sizeof() */
+                    else
+                        BracketDepth--;
+                    break;
+                    
+                case TokenLeftBrace:
+                    if (InInitialiser)
+                        BracketDepth++;
+                    else
+                        InDeclaration = FALSE;
+                    break;
+                    
+                case TokenRightBrace:
+                    if (InInitialiser && BracketDepth > 0)
+                        BracketDepth--;
+                    else
+                        InDeclaration = FALSE;
+                    break;
+                    
+                case TokenAssign:
+                    if (BracketDepth == 0)
+                        InInitialiser = TRUE;
+                    break;
+                    
+                case TokenComma:
+                    if (BracketDepth == 0)
+                        InInitialiser = FALSE;
+                    break;
+                    
+                case TokenSemicolon:
+                    InDeclaration = FALSE;
+                    break;
+                    
+                default:
+                    break;
+            }
+        }
+        
+        if (Token != TokenEndOfLine)
+            PrevToken = Token;
+            
+        Pos = Next;
+    }
+}
+
+static const unsigned char *LexFoldExpression(struct FoldState *Fold, const unsigned char *Pos, int Depth);
+
+/* check the type name in a sizeof(), returning where it ends or NULL if it's not
+ * one we can size yet */
+static const unsigned char *LexFoldTypeName(struct FoldState *Fold, const unsigned char *Pos)
+{
+    const unsigned char *Next;
+    enum LexToken Token = LexFoldGetToken(Pos, &Next);
+    struct ValueType *Typ;
+    struct Value *Val;
+    
+    if (Token == TokenIdentifier)
+    {
+        /* a typedef name on its own */
+        Val = LexFoldGetGlobal(Fold, LexFoldGetIdentifier(Pos));
+        if (Val == NULL || Val->Typ->Base != Type_Type)
+            return NULL;
+            
+        Typ = Val->Val->Typ;
+        if ((Typ->Base == TypeStruct || Typ->Base == TypeUnion) && Typ->Members == NULL)
+            return NULL;
+            
+        return Next;
+    }
+    
+    if (Token == TokenStructType || Token == TokenUnionType)
+    {
+        /* only structs and unions which have been fully defined */
+        if (LexFoldGetToken(Next, NULL) != TokenIdentifier)
+            return NULL;
+            
+        Typ = TypeLookup(Fold->pc, &Fold->pc->UberType, (Token == TokenStructType) ? TypeStruct : TypeUnion, 0, LexFoldGetIdentifier(Next));
+        if (Typ == NULL || Typ->Members == NULL)
+            return NULL;
+            
+        LexFoldGetToken(Next, &Pos);
+    }
+    else
+    {
+        /* a basic type, possibly signed or unsigned */
+        if (Token == TokenSignedType || Token == TokenUnsignedType)
+            Token = LexFoldGetToken(Next, &Next);
+            
+        if (Token != TokenIntType && Token != TokenCharType && Token != TokenShortType && Token != TokenLongType && Token != TokenFloatType && Token != TokenDoubleType)
+            return NULL;
+            
+        Pos = Next;
+    }
+    
+    while (LexFoldGetToken(Pos, &Next) == TokenAsterisk)
+        Pos = Next;
+        
+    return Pos;
+}
+
+/* check a constant value, returning where it ends or NULL if it isn't constant */
+static const unsigned char *LexFoldPrimary(struct FoldState *Fold, const unsigned char *Pos, int Depth)
+{
+    const unsigned char *Next;
+    const unsigned char *End;
+    struct Value *Val;
+    
+    switch (LexFoldGetToken(Pos, &Next))
+    {
+        case TokenIntegerConstant: 
+        case TokenCharacterConstant:
+            return Next;
+            
+        case TokenFPConstant:
+            Fold->UsesFP = TRUE;
+            return Next;
+            
+        case TokenIdentifier:
+            Val = LexFoldGetGlobal(Fold, LexFoldGetIdentifier(Pos));
+            if (Val == NULL)
+                return NULL;
+            
+            if (Val->IsConstant && IS_INTEGER_NUMERIC(Val))
+                return Next;
+            
+            if (Val->Typ == &Fold->pc->MacroType && Val->Val->MacroDef.NumParams == 0 && Depth < FOLD_MACRO_DEPTH)
+            {
+                /* a macro is constant if its whole body is */
+                End = LexFoldExpression(Fold, Val->Val->MacroDef.Body.Pos, Depth+1);
+                if (End != NULL && LexFoldPeekToken(End) == TokenEndOfFunction)
+                    return Next;
+            }
+            return NULL;
+            
+        case TokenOpenBracket:
+            End = LexFoldExpression(Fold, Next, Depth);
+            if (End == NULL || LexFoldGetToken(End, &Next) != TokenCloseBracket)
+                return NULL;
+                
+            return Next;
+            
+        default:
+            return NULL;
+    }
+}
+
+/* check a constant value with any prefix operators */
+static const unsigned char *LexFoldUnary(struct FoldState *Fold, const unsigned char *Pos, int Depth)
+{
+    const unsigned char *Next;
+    const unsigned char *TypeEnd;
+    const unsigned char *BracketPos;
+    
+    switch (LexFoldGetToken(Pos, &Next))
+    {
+        case TokenPlus: 
+        case TokenMinus:
+            return LexFoldUnary(Fold, Next, Depth);
+            
+        case TokenUnaryNot: 
+        case TokenUnaryExor:
+            Fold->UsesIntegerOp = TRUE;
+            return LexFoldUnary(Fold, Next, Depth);
+            
+        case TokenSizeof:
+            if (LexFoldGetToken(Next, &BracketPos) != TokenOpenBracket)
+                return NULL;
+                
+            TypeEnd = LexFoldTypeName(Fold, BracketPos);
+            if (TypeEnd == NULL)
+                return LexFoldPrimary(Fold, Next, Depth);   /* sizeof a bracketed expression */
+                
+            if (LexFoldGetToken(TypeEnd, &Next) != TokenCloseBracket)
+                return NULL;
+                
+            return Next;
+            
+        default:
+            return LexFoldPrimary(Fold, Pos, Depth);
+    }
+}
+
+/* check a constant expression, returning where the longest constant expression
+ * from this point ends or NULL if there isn't one */
+static const unsigned char *LexFoldExpression(struct FoldState *Fold, const unsigned char *Pos, int Depth)
+{
+    const unsigned char *Next;
+    const unsigned char *OperandEnd;
+    const unsigned char *End = LexFoldUnary(Fold, Pos, Depth);
+    enum LexToken Token;
+    
+    while (End != NULL)
+    {
+        /* only plain binary operators - not assignments, ternaries or anything with side effects */
+        Token = LexFoldGetToken(End, &Next);
+        if (Token < TokenLogicalOr || Token > TokenModulus)
+            break;
+            
+        /* don't risk dividing by zero for code which might never run */
+        if ((Token == TokenSlash || Token == TokenModulus) && !LexFoldIsNonZeroLiteral(Next))
+            break;
+            
+        OperandEnd = LexFoldUnary(Fold, Next, Depth);
+        if (OperandEnd == NULL)
+            break;
+            
+        switch (Token)
+        {
+            case TokenLogicalOr: case TokenLogicalAnd: case TokenArithmeticOr: case TokenArithmeticExor: case TokenAmpersand:
+            case TokenShiftLeft: case TokenShiftRight: case TokenModulus:
+                Fold->UsesIntegerOp = TRUE;
+                break;
+                
+            default:
+                break;
+        }
+        
+        End = OperandEnd;
+    }
+    
+    return End;
+}
+
+/* can a whole constant expression be folded when it comes after this token? */
+static int LexFoldIsExpressionStart(enum LexToken Token)
+{
+    switch (Token)
+    {
+        case TokenOpenBracket: case TokenComma: case TokenLeftSquareBracket: case TokenReturn: case TokenCase: 
+        case TokenQuestionMark: case TokenColon: case TokenSemicolon: case TokenLeftBrace: case TokenRightBrace:
+            return TRUE;
+            
+        default:
+            return Token >= TokenAssign && Token <= TokenArithmeticExorAssign;
+    }
+}
+
+/* work out how much of the tokens at this position can be folded, returning where the
+ * folded part ends or NULL if none of it can */
+static const unsigned char *LexFoldRange(struct FoldState *Fold, const unsigned char *Pos, enum LexToken PrevToken)
+{
+    const unsigned char *Next;
+    const unsigned char *End;
+    enum LexToken NextToken;
+    int ColonAllowed = (PrevToken == TokenCase || PrevToken == TokenQuestionMark);
+    
+    LexFoldGetToken(Pos, &Next);
+    if (LexFoldIsExpressionStart(PrevToken))
+    {
+        /* a whole expression, delimited so nothing around it could bind more tightly */
+        Fold->UsesFP = FALSE;
+        Fold->UsesIntegerOp = FALSE;
+        End = LexFoldExpression(Fold, Pos, 0);
+        if (End != NULL && End != Next && !(Fold->UsesFP && Fold->UsesIntegerOp))
+        {
+            NextToken = LexFoldPeekToken(End);
+            if (NextToken == TokenCloseBracket || NextToken == TokenComma || NextToken == TokenSemicolon || 
+                NextToken == TokenRightSquareBracket || NextToken == TokenRightBrace || (NextToken == TokenColon && ColonAllowed))
+                return End;
+        }
+    }
+    
+    if (*Pos == TokenIdentifier)
+    {
+        /* a lone macro or enum constant, as long as it isn't being used as a name */
+        if (PrevToken == TokenDot || PrevToken == TokenArrow || PrevToken == TokenGoto || IS_TYPE_KEYWORD_TOKEN(PrevToken))
+            return NULL;
+            
+        NextToken = LexFoldPeekToken(Next);
+        if (NextToken == TokenOpenBracket || NextToken == TokenLeftSquareBracket || NextToken == TokenDot || NextToken == TokenArrow || 
+            NextToken == TokenIncrement || NextToken == TokenDecrement || (NextToken >= TokenAssign && NextToken <= TokenArithmeticExorAssign) ||
+            (NextToken == TokenColon && !ColonAllowed))
+            return NULL;
+            
+        Fold->UsesFP = FALSE;
+        Fold->UsesIntegerOp = FALSE;
+        End = LexFoldPrimary(Fold, Pos, 0);
+        if (End != NULL && !(Fold->UsesFP && Fold->UsesIntegerOp))
+            return End;
+    }
+    
+    return NULL;
+}
+
+/* evaluate a constant expression and write it out as a single folded token */
+static int LexFoldEvaluate(struct ParseState *Body, const unsigned char *Pos, const unsigned char *End, unsigned char *FoldedPos)
+{
+    Picoc *pc = Body->pc;
+    struct ParseState EvalParser;
+    struct Value *Result;
+    union FoldedData Data;
+    unsigned char *EvalTokens;
+    int ColumnSize = LexTokenValue(Pos) - Pos - 1;
+    int EvalSize = End - Pos + TOKEN_END_SIZE;
+    int Ok = FALSE;
+    
+    /* evaluate a terminated copy of the tokens so the expression can't run on past the end */
+    EvalTokens = HeapAllocStackUninitialised(pc, EvalSize);
+    if (EvalTokens == NULL)
+        return FALSE;
+        
+    memcpy((void *)EvalTokens, (void *)Pos, End - Pos);
+    EvalTokens[End - Pos] = (unsigned char)TokenEndOfFunction;
+    ParserCopy(&EvalParser, Body);
+    EvalParser.Pos = EvalTokens;
+    EvalParser.Mode = RunModeRun;
+    if (ExpressionParse(&EvalParser, &Result))
+    {
+        Ok = LexGetToken(&EvalParser, NULL, FALSE) == TokenEndOfFunction && (IS_INTEGER_NUMERIC(Result) || IS_FP(Result));
+        if (Ok)
+        {
+            memset((void *)&Data, '\0', sizeof(Data));
+            memcpy((void *)&Data, (void *)Result->Val, TypeSize(Result->Typ, 0, TRUE));
+            FoldedPos[0] = (unsigned char)TokenFoldedConstant;
+            memcpy((void *)&FoldedPos[1], (void *)&Pos[1], ColumnSize);     /* keep the original column */
+            memcpy((void *)&FoldedPos[1 + ColumnSize], (void *)&Result->Typ, sizeof(struct ValueType *));
+            memcpy((void *)&FoldedPos[1 + ColumnSize + sizeof(struct ValueType *)], (void *)&Data, sizeof(Data));
+        }
+        
+        VariableStackPop(&EvalParser, Result);
+    }
+    
+    HeapPopStack(pc, EvalTokens, EvalSize);
+    return Ok;
+}
+
+/* fold the constant expressions in a function body into single tokens so they don't get 
+ * worked out every time the function runs. constants are literals, macros without 
+ * parameters, enum constants and sizeof() complete types. folding never crosses a line 
+ * so line numbers stay the same, and a folded token keeps the column it started at */
+void LexFoldConstants(Picoc *pc, struct FuncDef *FuncDef)
+{
+    struct FoldState Fold;
+    const unsigned char *Pos;
+    const unsigned char *Next;
+    const unsigned char *End;
+    unsigned char *FoldSpace;
+    unsigned char *FoldedPos;
+    unsigned char *NewTokens;
+    enum LexToken Token;
+    enum LexToken PrevToken = TokenNone;
+    int NumIdentifiers = 0;
+    int DeclaredSize;
+    int ReserveSpace;
+    int DidFold = FALSE;
+    
+    /* interactive input comes a line at a time so leave it alone */
+    if (FuncDef->Body.FileName == pc->StrEmpty)
+        return;
+    
+    for (Pos = FuncDef->Body.Pos; (Token = LexFoldGetToken(Pos, &Next)) != TokenEndOfFunction; Pos = Next)
+    {
+        if (Token == TokenIdentifier)
+            NumIdentifiers++;
+    }
+    
+    /* a folded token can be up to six times the size of the shortest tokens it replaces */
+    ReserveSpace = (Pos - FuncDef->Body.Pos) * 6 + TOKEN_END_SIZE;
+    Fold.pc = pc;
+    DeclaredSize = sizeof(char *) * (NumIdentifiers + FuncDef->NumParams + 1);
+    Fold.Declared = HeapAllocStackUninitialised(pc, DeclaredSize);
+    FoldSpace = HeapAllocStackUninitialised(pc, ReserveSpace);
+    if (Fold.Declared == NULL || FoldSpace == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+    
+    for (Fold.NumDeclared = 0; Fold.NumDeclared < FuncDef->NumParams; Fold.NumDeclared++)
+        Fold.Declared[Fold.NumDeclared] = FuncDef->ParamName[Fold.NumDeclared];
+        
+    LexFoldFindDeclarations(&Fold, FuncDef->Body.Pos);
+    
+    FoldedPos = FoldSpace;
+    Pos = FuncDef->Body.Pos;
+    while ((Token = LexFoldGetToken(Pos, &Next)) != TokenEndOfFunction)
+    {
+        End = NULL;
+        if (Token >= TokenHashDefine && Token <= TokenHashEndif)
+        {
+            /* leave preprocessor lines alone */
+            while (*Next != TokenEndOfLine && *Next != TokenEndOfFunction)
+                LexFoldGetToken(Next, &Next);
+        }
+        else if (Token != TokenEndOfLine)
+            End = LexFoldRange(&Fold, Pos, PrevToken);
+        
+        if (End != NULL && LexFoldEvaluate(&FuncDef->Body, Pos, End, FoldedPos))
+        {
+            FoldedPos = (unsigned char *)LexNextToken(FoldedPos);
+            PrevToken = TokenFoldedConstant;
+            DidFold = TRUE;
+            Pos = End;
+        }
+        else
+        {
+            memcpy((void *)FoldedPos, (void *)Pos, Next - Pos);
+            FoldedPos += Next - Pos;
+            if (Token != TokenEndOfLine)
+                PrevToken = Token;
+                
+            Pos = Next;
+        }
+    }
+    
+    if (DidFold)
+    {
+        /* replace the body with the folded version */
+        memcpy((void *)FoldedPos, (void *)Pos, TOKEN_END_SIZE);
+        FoldedPos += TOKEN_END_SIZE;
+        NewTokens = HeapAllocMemUninitialised(pc, FoldedPos - FoldSpace);
+        if (NewTokens == NULL)
+            ProgramFailNoParser(pc, "out of memory");
+            
+        memcpy((void *)NewTokens, (void *)FoldSpace, FoldedPos - FoldSpace);
+        HeapFreeMem(pc, (void *)FuncDef->Body.Pos);
+        FuncDef->Body.Pos = NewTokens;
+    }
+    
+    HeapPopStack(pc, FoldSpace, ReserveSpace);
+    HeapPopStack(pc, Fold.Declared, DeclaredSize);
+}
+
 /* indicate that we've completed up to this point in the interactive input and free expired tokens */
 void LexInteractiveClear(Picoc *pc, struct ParseState *Parser)
 {
@@ -998,6 +1893,7 @@ void LexInteractiveClear(Picoc *pc, struct ParseState *Parser)
     {
         struct TokenLine *NextLine = pc->InteractiveHead->Next;
         
+        ParseFreeInitialiserImages(pc);
         HeapFreeMem(pc, pc->InteractiveHead->Tokens);
         HeapFreeMem(pc, pc->InteractiveHead);
         pc->InteractiveHead = NextLine;
@@ -1017,6 +1913,7 @@ void LexInteractiveCompleted(Picoc *pc, struct ParseState *Parser)
         /* this token line is no longer needed - free it */
         struct TokenLine *NextLine = pc->InteractiveHead->Next;
         
+        ParseFreeInitialiserImages(pc);
         HeapFreeMem(pc, pc->InteractiveHead->Tokens);
         HeapFreeMem(pc, pc->InteractiveHead);
         pc->InteractiveHead = NextLine;
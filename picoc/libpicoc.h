@@ -0,0 +1,50 @@
+/* picoc's in-memory run interface. This is the only header you need if you're
+ * linking with libpicoc to run programs, and it doesn't need any of the
+ * interpreter's build settings. The interpreter itself is in picoc.h */
+#ifndef LIBPICOC_H
+#define LIBPICOC_H
+
+#include <stddef.h>
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+/* how PicocRun() should run a program */
+struct PicocRunOptions
+{
+    const char *FileName;               /* the file name errors are reported against, NULL for "source.c" */
+    const char *Stdin;                  /* the program's standard input, NULL for none */
+    int StdinLen;
+    int Trace;                          /* TRUE to record a trace of each line run */
+    int StackSize;                      /* the most the stack can grow to, 0 for the default */
+    int ForkEach;                       /* PicocRunInputs() only - TRUE to run each input in a child forked after the parse */
+    int TimeLimit;                      /* with ForkEach, the seconds each input can run for, 0 for no limit */
+};
+
+/* what happened when PicocRun() ran a program */
+struct PicocResult
+{
+    int ExitValue;                      /* the value passed to exit() or returned from main() */
+    char *Stdout;                       /* what the program wrote to stdout */
+    size_t StdoutLen;
+    char *Stderr;                       /* what the program wrote to stderr */
+    size_t StderrLen;
+    char *Trace;                        /* the trace as one line of JSON per step, NULL if it wasn't asked for */
+    size_t TraceLen;
+    int Failed;                         /* TRUE if the program stopped with an error */
+    int ErrorLine;                      /* where the error happened */
+    int ErrorColumn;
+    char *ErrorMessage;
+};
+
+/* PicocRunInputs() hands each result to one of these, which returns FALSE to stop */
+typedef int PicocRunDone(int Input, struct PicocResult *Result, void *Arg);
+
+/* platform/embed_unix.c */
+int PicocRun(const char *Source, int SourceLen, const struct PicocRunOptions *Options, struct PicocResult *Result);
+int PicocRunInputs(const char *Source, int SourceLen, const struct PicocRunOptions *Options, int NumInputs, const char **Inputs, const int *InputLens, PicocRunDone *Done, void *Arg);
+void PicocResultFree(struct PicocResult *Result);
+
+#endif /* LIBPICOC_H */
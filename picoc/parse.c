@@ -17,6 +17,25 @@ void ParseCleanup(Picoc *pc)
         HeapFreeMem(pc, pc->CleanupTokenList);
         pc->CleanupTokenList = Next;
     }
+    
+    ParseFreeInitialiserImages(pc);
+}
+
+/* free all the initialiser images - they're keyed on token positions so must go when tokens are freed */
+void ParseFreeInitialiserImages(Picoc *pc)
+{
+    int Count;
+    
+    for (Count = 0; Count < INITIALISER_IMAGE_TABLE_SIZE; Count++)
+    {
+        while (pc->InitialiserImages[Count] != NULL)
+        {
+            struct InitialiserImage *Next = pc->InitialiserImages[Count]->Next;
+            
+            HeapFreeMem(pc, pc->InitialiserImages[Count]);
+            pc->InitialiserImages[Count] = Next;
+        }
+    }
 }
 
 /* parse a statement, but only run it if Condition is TRUE */
@@ -148,6 +167,7 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueTyp
 
         FuncValue->Val->FuncDef.Body = FuncBody;
         FuncValue->Val->FuncDef.Body.Pos = LexCopyTokens(&FuncBody, Parser);
+        LexFoldConstants(pc, &FuncValue->Val->FuncDef);
 
         /* is this function already in the global table? */
         if (TableGet(&pc->GlobalTable, Identifier, &OldFuncValue, NULL, NULL, NULL))
@@ -168,6 +188,67 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser, struct ValueTyp
     return FuncValue;
 }
 
+/* assign a lone literal array element directly rather than evaluating it as an expression.
+ * with a NULL ElementType the literal is just skipped over */
+static int ParseInitialiserLiteral(struct ParseState *Parser, struct ValueType *ElementType, union AnyValue *ElementData)
+{
+    struct ParseState LiteralParser;
+    struct Value *LexValue;
+    struct Value SourceValue;
+    struct Value DestValue;
+    union AnyValue SourceData;
+    enum LexToken Token;
+    int Negate = FALSE;
+    
+    ParserCopy(&LiteralParser, Parser);
+    Token = LexGetToken(&LiteralParser, &LexValue, TRUE);
+    if (Token == TokenMinus)
+    {
+        Negate = TRUE;
+        Token = LexGetToken(&LiteralParser, &LexValue, TRUE);
+    }
+    
+    if (Token != TokenIntegerConstant && Token != TokenCharacterConstant && Token != TokenFPConstant)
+        return FALSE;
+    
+    memset((void *)&SourceValue, '\0', sizeof(SourceValue));
+    SourceValue.Val = &SourceData;
+    switch (Token)
+    {
+        case TokenCharacterConstant:
+            SourceValue.Typ = &Parser->pc->IntType;
+            SourceData.Integer = Negate ? -LexValue->Val->Character : LexValue->Val->Character;
+            break;
+#ifndef NO_FP
+        case TokenFPConstant:
+            SourceValue.Typ = &Parser->pc->FPType;
+            SourceData.FP = Negate ? -LexValue->Val->FP : LexValue->Val->FP;
+            break;
+#endif
+        default:
+            SourceValue.Typ = &Parser->pc->LongType;
+            SourceData.LongInteger = Negate ? -LexValue->Val->LongInteger : LexValue->Val->LongInteger;
+            break;
+    }
+    
+    /* it must be the whole element */
+    Token = LexGetToken(&LiteralParser, NULL, FALSE);
+    if (Token != TokenComma && Token != TokenRightBrace)
+        return FALSE;
+    
+    if (ElementType != NULL)
+    {
+        memset((void *)&DestValue, '\0', sizeof(DestValue));
+        DestValue.Typ = ElementType;
+        DestValue.Val = ElementData;
+        DestValue.IsLValue = TRUE;
+        ExpressionAssign(Parser, &DestValue, &SourceValue, FALSE, NULL, 0, FALSE);
+    }
+    
+    ParserCopyPos(Parser, &LiteralParser);
+    return TRUE;
+}
+
 /* parse an array initialiser and assign to a variable */
 int ParseArrayInitialiser(struct ParseState *Parser, struct Value *NewVariable, int DoAssignment)
 {
@@ -226,6 +307,8 @@ int ParseArrayInitialiser(struct ParseState *Parser, struct Value *NewVariable,
         else
         {
             struct Value *ArrayElement = NULL;
+            union AnyValue *ElementData;
+            int IsLiteral = FALSE;
         
             if (Parser->Mode == RunModeRun && DoAssignment)
             {
@@ -250,14 +333,21 @@ int ParseArrayInitialiser(struct ParseState *Parser, struct Value *NewVariable,
                 #endif
                 if (ArrayIndex >= TotalSize)
                     ProgramFail(Parser, "too many array elements");
-                ArrayElement = VariableAllocValueFromExistingData(Parser, ElementType, (union AnyValue *)(&NewVariable->Val->ArrayMem[0] + ElementSize * ArrayIndex), TRUE, NewVariable);
+                
+                ElementData = (union AnyValue *)(&NewVariable->Val->ArrayMem[0] + ElementSize * ArrayIndex);
+                if (ElementType->Base != TypeArray && ParseInitialiserLiteral(Parser, ElementType, ElementData))
+                    IsLiteral = TRUE;
+                else
+                    ArrayElement = VariableAllocValueFromExistingData(Parser, ElementType, ElementData, TRUE, NewVariable);
             }
+            else if (Parser->Mode == RunModeRun)
+                IsLiteral = ParseInitialiserLiteral(Parser, NULL, NULL);
 
             /* this is a normal expression initialiser */
-            if (!ExpressionParse(Parser, &CValue))
+            if (!IsLiteral && !ExpressionParse(Parser, &CValue))
                 ProgramFail(Parser, "expression expected");
 
-            if (Parser->Mode == RunModeRun && DoAssignment)
+            if (Parser->Mode == RunModeRun && DoAssignment && !IsLiteral)
             {
                 ExpressionAssign(Parser, ArrayElement, CValue, FALSE, NULL, 0, FALSE);
                 VariableStackPop(Parser, CValue);
@@ -285,6 +375,84 @@ int ParseArrayInitialiser(struct ParseState *Parser, struct Value *NewVariable,
     return ArrayIndex;
 }
 
+/* check if the initialiser starting at this opening brace contains nothing but constants */
+static int ParseInitialiserIsConstant(struct ParseState *Parser)
+{
+    struct ParseState ScanParser;
+    int Depth = 0;
+    
+    ParserCopy(&ScanParser, Parser);
+    do
+    {
+        switch (LexGetToken(&ScanParser, NULL, TRUE))
+        {
+            case TokenLeftBrace: Depth++; break;
+            case TokenRightBrace: Depth--; break;
+            case TokenComma: case TokenIntegerConstant: case TokenFPConstant: case TokenStringConstant: case TokenCharacterConstant: case TokenFoldedConstant:
+            case TokenPlus: case TokenMinus: case TokenAsterisk: case TokenSlash: case TokenModulus:
+            case TokenShiftLeft: case TokenShiftRight: case TokenAmpersand: case TokenArithmeticOr: case TokenArithmeticExor:
+            case TokenUnaryNot: case TokenUnaryExor: case TokenOpenBracket: case TokenCloseBracket:
+                break;
+            default: return FALSE;
+        }
+    } while (Depth > 0);
+    
+    return TRUE;
+}
+
+/* run an array initialiser, replaying the byte image from an earlier run if it's constant */
+static void ParseArrayInitialiserImage(struct ParseState *Parser, struct Value *NewVariable)
+{
+    Picoc *pc = Parser->pc;
+    const unsigned char *BracePos = Parser->Pos;
+    struct ValueType *DeclType = NewVariable->Typ;
+    struct InitialiserImage **Bucket = &pc->InitialiserImages[INITIALISER_IMAGE_HASH(BracePos)];
+    struct InitialiserImage *Image;
+    int IsConstant;
+    int Size;
+    
+    for (Image = *Bucket; Image != NULL; Image = Image->Next)
+    {
+        if (Image->Pos == BracePos && Image->DeclType == DeclType)
+        {
+            if (DeclType != Image->Typ)
+            {
+                NewVariable->Typ = Image->Typ;
+                VariableRealloc(Parser, NewVariable, Image->Size);
+            }
+            
+            memcpy((void *)NewVariable->Val, (void *)&Image->Data[0], Image->Size);
+            Parser->Pos = Image->EndPos;
+            Parser->Line = Image->EndLine;
+            Parser->CharacterPos = Image->EndCharacterPos;
+            return;
+        }
+    }
+    
+    /* no image yet - do it the long way and remember the result if it can't change */
+    IsConstant = DeclType->Base == TypeArray && ParseInitialiserIsConstant(Parser);
+    LexGetToken(Parser, NULL, TRUE);
+    ParseArrayInitialiser(Parser, NewVariable, TRUE);
+    if (!IsConstant)
+        return;
+    
+    Size = TypeSizeValue(NewVariable, FALSE);
+    Image = HeapAllocMem(pc, sizeof(struct InitialiserImage) + Size);
+    if (Image == NULL)
+        return;
+    
+    Image->Pos = BracePos;
+    Image->DeclType = DeclType;
+    Image->Typ = NewVariable->Typ;
+    Image->EndPos = Parser->Pos;
+    Image->EndLine = Parser->Line;
+    Image->EndCharacterPos = Parser->CharacterPos;
+    Image->Size = Size;
+    memcpy((void *)&Image->Data[0], (void *)NewVariable->Val, Size);
+    Image->Next = *Bucket;
+    *Bucket = Image;
+}
+
 /* assign an initial value to a variable */
 void ParseDeclarationAssignment(struct ParseState *Parser, struct Value *NewVariable, int DoAssignment)
 {
@@ -293,8 +461,13 @@ void ParseDeclarationAssignment(struct ParseState *Parser, struct Value *NewVari
     if (LexGetToken(Parser, NULL, FALSE) == TokenLeftBrace)
     {
         /* this is an array initialiser */
-        LexGetToken(Parser, NULL, TRUE);
-        ParseArrayInitialiser(Parser, NewVariable, DoAssignment);
+        if (Parser->Mode == RunModeRun && DoAssignment)
+            ParseArrayInitialiserImage(Parser, NewVariable);
+        else
+        {
+            LexGetToken(Parser, NULL, TRUE);
+            ParseArrayInitialiser(Parser, NewVariable, DoAssignment);
+        }
     }
     else
     {
@@ -387,6 +560,7 @@ void ParseMacroDefinition(struct ParseState *Parser)
         NumParams = ParseCountParams(&ParamParser);
         MacroValue = VariableAllocValueAndData(Parser->pc, Parser, sizeof(struct MacroDef) + sizeof(const char *) * NumParams, FALSE, NULL, TRUE);
         MacroValue->Val->MacroDef.NumParams = NumParams;
+        MacroValue->Val->MacroDef.IsTemplate = FALSE;
         MacroValue->Val->MacroDef.ParamName = (char **)((char *)MacroValue->Val + sizeof(struct MacroDef));
 
         Token = LexGetToken(Parser, &ParamName, TRUE);
@@ -413,6 +587,7 @@ void ParseMacroDefinition(struct ParseState *Parser)
         /* allocate a simple unparameterised macro */
         MacroValue = VariableAllocValueAndData(Parser->pc, Parser, sizeof(struct MacroDef), FALSE, NULL, TRUE);
         MacroValue->Val->MacroDef.NumParams = 0;
+        MacroValue->Val->MacroDef.IsTemplate = FALSE;
     }
     
     /* copy the body of the macro to execute later */
@@ -420,6 +595,8 @@ void ParseMacroDefinition(struct ParseState *Parser)
     MacroValue->Typ = &Parser->pc->MacroType;
     LexToEndOfLine(Parser);
     MacroValue->Val->MacroDef.Body.Pos = LexCopyTokens(&MacroValue->Val->MacroDef.Body, Parser);
+    if (MacroValue->Val->MacroDef.NumParams > 0)
+        LexMacroTemplate(&MacroValue->Val->MacroDef);
     
     if (!TableSet(Parser->pc, &Parser->pc->GlobalTable, MacroNameStr, MacroValue, (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
         ProgramFail(Parser, "'%s' is already defined", MacroNameStr);
@@ -650,6 +827,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser, int CheckTrailingSemi
         case TokenIncrement: 
         case TokenDecrement: 
         case TokenOpenBracket: 
+        case TokenFoldedConstant:
             *Parser = PreState;
             ExpressionParse(Parser, &CValue);
             if (Parser->Mode == RunModeRun) 
@@ -943,8 +1121,14 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceL
     enum ParseResult Ok;
     struct CleanupTokenNode *NewCleanupNode;
     char *RegFileName = TableStrRegister(pc, FileName);
+    void *Tokens;
+    char Here;
     
-    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
+    /* we may be running on a different thread from the one we were set up on */
+    if ((unsigned long)&Here < pc->CStackLimit || (unsigned long)&Here > pc->CStackTop)
+        PlatformStackInit(pc);
+    
+    Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
     
     /* allocate a cleanup node so we can clean up the tokens later */
     if (!CleanupNow)
@@ -975,7 +1159,10 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source, int SourceL
     
     /* clean up */
     if (CleanupNow)
+    {
+        ParseFreeInitialiserImages(pc);
         HeapFreeMem(pc, Tokens);
+    }
 }
 
 /* parse interactively */
@@ -983,6 +1170,10 @@ void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger)
 {
     struct ParseState Parser;
     enum ParseResult Ok;
+    char Here;
+    
+    if ((unsigned long)&Here < pc->CStackLimit || (unsigned long)&Here > pc->CStackTop)
+        PlatformStackInit(pc);
     
     LexInitParser(&Parser, pc, NULL, NULL, pc->StrEmpty, TRUE, EnableDebugger);
     PicocPlatformSetExitPoint(pc);
@@ -17,28 +17,29 @@
 
 #include "trace.h"
 
-#define PICOC_STACK_SIZE (128*1024)              /* space for the the stack */
+#define PICOC_STACK_SIZE (8*1024*1024)           /* the most the stack can grow to */
 
-int main(int argc, char **argv)
+/* the command line, for PicocMain() on the thread it runs on */
+struct PicocCommandLine
+{
+    int argc;
+    char **argv;
+    int StackSize;
+};
+
+/* run programs the way the command line says */
+static int PicocMain(void *Arg)
 {
+    struct PicocCommandLine *CommandLine = Arg;
+    int argc = CommandLine->argc;
+    char **argv = CommandLine->argv;
     int ParamCount = 1;
     int DontRunMain = FALSE;
     const char *stdout_file;
-    int StackSize = getenv("STACKSIZE") ? atoi(getenv("STACKSIZE")) : PICOC_STACK_SIZE;
     Picoc pc;
     int fd;
     
-    if (argc < 2)
-    {
-        printf("Format: picoc <csource1.c>... [- <arg1>...]    : run a program (calls main() to start it)\n"
-               "        picoc -s <csource1.c>... [- <arg1>...] : script mode - runs the program without calling main()\n"
-               "        picoc -i                               : interactive mode\n"
-               "        picoc -t                               : set the trace file name\n");
-        exit(1);
-    }
-    
-    trace_set_filename(NULL);
-    PicocInitialise(&pc, StackSize);
+    PicocInitialise(&pc, CommandLine->StackSize);
     
     if (strcmp(argv[ParamCount], "-s") == 0 || strcmp(argv[ParamCount], "-m") == 0)
     {
@@ -47,6 +48,27 @@ int main(int argc, char **argv)
         ParamCount++;
     }
         
+#ifdef UNIX_HOST
+    if (strcmp(argv[ParamCount], "--zygote") == 0)
+    {
+        if (argc != 3)
+        {
+            printf("Format: picoc --zygote <socket>\n");
+            exit(1);
+        }
+        
+        if (PicocPlatformSetExitPoint(&pc))
+        {
+            PicocCleanup(&pc);
+            return pc.PicocExitValue;
+        }
+        
+        /* each job gets a forked copy of an interpreter which has already been set up */
+        PicocIncludeAllSystemHeaders(&pc);
+        PicocZygote(&pc, argv[2]);
+    }
+#endif
+    
     if (argc > ParamCount && strcmp(argv[ParamCount], "-i") == 0)
     {
         PicocIncludeAllSystemHeaders(&pc);
@@ -56,10 +78,10 @@ int main(int argc, char **argv)
     {
         if(argc > ParamCount && strcmp(argv[ParamCount], "-t") == 0)
         {
-            trace_set_filename(argv[++ParamCount]);
+            trace_set_filename(&pc, argv[++ParamCount]);
             ParamCount++;
 
-            stdout_file = trace_get_stdout_file();
+            stdout_file = trace_get_stdout_file(&pc);
             fd = open(stdout_file, O_RDWR | O_CREAT | O_TRUNC | O_SYNC, S_IRUSR | S_IWUSR);
             dup2(fd, 1);
             close(fd);
@@ -82,6 +104,52 @@ int main(int argc, char **argv)
     PicocCleanup(&pc);
     return pc.PicocExitValue;
 }
+
+int main(int argc, char **argv)
+{
+    int StackSize = getenv("STACKSIZE") ? atoi(getenv("STACKSIZE")) : PICOC_STACK_SIZE;
+    struct PicocCommandLine CommandLine;
+    
+    if (argc < 2)
+    {
+        printf("Format: picoc <csource1.c>... [- <arg1>...]    : run a program (calls main() to start it)\n"
+               "        picoc -s <csource1.c>... [- <arg1>...] : script mode - runs the program without calling main()\n"
+               "        picoc -i                               : interactive mode\n"
+               "        picoc -t                               : set the trace file name\n"
+               "        picoc --zygote <socket>                : serve jobs from a unix socket, forking for each one\n"
+               "        picoc --serve-stdio                    : serve jobs from stdin, replying on stdout\n"
+#ifdef USE_MALLOC_HEAP
+               "        picoc --grade <csource.c> <input>...   : parse once, then run with each input file as stdin\n"
+#endif
+               );
+        exit(1);
+    }
+    
+#ifdef UNIX_HOST
+    /* each job gets an interpreter of its own so there's nothing to set up here */
+    if (strcmp(argv[1], "--serve-stdio") == 0)
+        return PicocServeStdio(StackSize);
+        
+#ifdef USE_MALLOC_HEAP
+    if (strcmp(argv[1], "--grade") == 0)
+    {
+        if (argc < 3)
+        {
+            printf("Format: picoc --grade <csource.c> <input>...\n");
+            exit(1);
+        }
+        
+        return PicocGrade(argv[2], argc - 3, &argv[3], StackSize);
+    }
+#endif
+#endif
+
+    /* the interpreter runs on a C stack sized to go with its own stack */
+    CommandLine.argc = argc;
+    CommandLine.argv = argv;
+    CommandLine.StackSize = StackSize;
+    return PicocPlatformRunOnStack(StackSize, &PicocMain, &CommandLine);
+}
 #else
 # ifdef SURVEYOR_HOST
 #  define HEAP_SIZE C_HEAPSIZE
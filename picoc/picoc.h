@@ -1,5 +1,7 @@
 /* picoc external interface. This should be the only header you need to use if
- * you're using picoc as a library. Internal details are in interpreter.h */
+ * you're building picoc into your program. Internal details are in
+ * interpreter.h. If you only want to run programs with PicocRun() use
+ * libpicoc.h instead, which doesn't need any of this */
 #ifndef PICOC_H
 #define PICOC_H
 
@@ -42,8 +44,29 @@ void PicocCallMain(Picoc *pc, int argc, char **argv);
 void PicocInitialise(Picoc *pc, int StackSize);
 void PicocCleanup(Picoc *pc);
 void PicocPlatformScanFile(Picoc *pc, const char *FileName);
+#ifdef USE_MALLOC_HEAP
+void PicocSetResetPoint(Picoc *pc);
+void PicocReset(Picoc *pc);
+#endif
 
 /* include.c */
 void PicocIncludeAllSystemHeaders(Picoc *pc);
 
+#if defined(UNIX_HOST) || defined(WIN32)
+/* platform/platform_XX.c */
+int PicocPlatformRunOnStack(int StackSize, int (*Func)(void *), void *Arg);
+#endif
+
+#ifdef UNIX_HOST
+/* platform/server_unix.c */
+void PicocZygote(Picoc *pc, const char *SocketPath);
+int PicocServeStdio(int StackSize);
+#ifdef USE_MALLOC_HEAP
+int PicocGrade(const char *FileName, int NumInputs, char **InputFiles, int StackSize);
+#endif
+
+/* platform/embed_unix.c */
+#include "libpicoc.h"
+#endif
+
 #endif /* PICOC_H */
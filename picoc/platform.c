@@ -13,6 +13,7 @@ void PicocInitialise(Picoc *pc, int StackSize)
     PlatformInit(pc);
     BasicIOInit(pc);
     HeapInit(pc, StackSize);
+    PlatformStackInit(pc);
     TableInit(pc);
     VariableInit(pc);
     LexInit(pc);
@@ -45,9 +46,124 @@ void PicocCleanup(Picoc *pc)
     TypeCleanup(pc);
     TableStrFree(pc);
     HeapCleanup(pc);
+    trace_set_filename(pc, NULL);
     PlatformCleanup(pc);
 }
 
+#ifdef USE_MALLOC_HEAP
+/* copy what's in the blocks the program has malloc()ed so PicocReset() can
+ * put it back. the blocks themselves are kept until the reset point goes */
+static void PicocSaveMallocs(Picoc *pc, struct ResetPoint *Point)
+{
+    long ImageSize = 0;
+    char *Image;
+    int Count;
+    
+    for (Count = 0; Count < pc->TotalMallocs; Count++)
+        ImageSize += pc->MallocInfo[Count][1];
+        
+    free(Point->MallocImage);
+    Point->MallocImage = malloc(ImageSize > 0 ? ImageSize : 1);
+    if (Point->MallocImage == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+        
+    Image = Point->MallocImage;
+    for (Count = 0; Count < pc->TotalMallocs; Count++)
+    {
+        memcpy(Image, (void *)pc->MallocInfo[Count][0], pc->MallocInfo[Count][1]);
+        Image += pc->MallocInfo[Count][1];
+    }
+}
+
+/* see if a block the program malloc()ed was there at the reset point. those
+ * have to stay where they are until the reset point goes, so free() leaves
+ * them alone */
+int PicocResetPointKeeps(Picoc *pc, void *Block)
+{
+    Picoc *Saved;
+    int Count;
+    
+    if (pc->ResetPoint == NULL)
+        return FALSE;
+        
+    Saved = pc->ResetPoint->Saved;
+    for (Count = 0; Count < Saved->TotalMallocs; Count++)
+    {
+        if ((void *)Saved->MallocInfo[Count][0] == Block)
+            return TRUE;
+    }
+    
+    return FALSE;
+}
+
+/* remember the interpreter as it is now so PicocReset() can take it back here.
+ * this is usually done once the system headers, or a whole program, have been
+ * parsed */
+void PicocSetResetPoint(Picoc *pc)
+{
+    if (pc->TopStackFrame != NULL)
+        ProgramFailNoParser(pc, "can't set a reset point inside a function");
+        
+    HeapSaveResetPoint(pc);
+    PicocSaveMallocs(pc, pc->ResetPoint);
+    memcpy(pc->ResetPoint->Saved, pc, sizeof(Picoc));
+}
+
+/* take the interpreter back to the reset point, undoing everything a program 
+ * has done since without freeing it piece by piece. the streams, trace files
+ * and exit point are left as the host has them */
+void PicocReset(Picoc *pc)
+{
+    struct ResetPoint *Point = pc->ResetPoint;
+    Picoc *Now;
+    char *Image;
+    int Count;
+    
+    if (Point == NULL)
+        ProgramFailNoParser(pc, "there's no reset point");
+    
+    Now = Point->Current;
+    memcpy(Now, pc, sizeof(Picoc));
+    memcpy(pc, Point->Saved, sizeof(Picoc));
+    
+    /* free whatever the program has malloc()ed since and not freed, and put
+     * back what was in the blocks it had at the reset point */
+    for (Count = 0; Count < Now->TotalMallocs; Count++)
+    {
+        if (!PicocResetPointKeeps(pc, (void *)Now->MallocInfo[Count][0]))
+            free((void *)Now->MallocInfo[Count][0]);
+    }
+    
+    Image = Point->MallocImage;
+    for (Count = 0; Count < pc->TotalMallocs; Count++)
+    {
+        memcpy((void *)pc->MallocInfo[Count][0], Image, pc->MallocInfo[Count][1]);
+        Image += pc->MallocInfo[Count][1];
+    }
+        
+    HeapRestoreResetPoint(pc);
+    
+    pc->CStackLimit = Now->CStackLimit;
+    pc->CStackTop = Now->CStackTop;
+    pc->CStdOut = Now->CStdOut;
+    pc->CStdOutBase = Now->CStdOutBase;
+#ifndef BUILTIN_MINI_STDLIB
+    pc->StdinValue = Now->StdinValue;
+    pc->StdoutValue = Now->StdoutValue;
+    pc->StderrValue = Now->StderrValue;
+#endif
+    memcpy(pc->PicocExitBuf, Now->PicocExitBuf, sizeof(pc->PicocExitBuf));
+    pc->TraceFile = Now->TraceFile;
+    pc->TraceStdoutFile = Now->TraceStdoutFile;
+    pc->TraceStream = Now->TraceStream;
+    pc->TraceBuffer = Now->TraceBuffer;
+    pc->TraceSize = Now->TraceSize;
+    pc->OutputBuffer = Now->OutputBuffer;
+    pc->OutputSize = Now->OutputSize;
+    pc->ErrorStream = Now->ErrorStream;
+}
+#endif
+
 /* platform-dependent code for running programs */
 #if defined(UNIX_HOST) || defined(WIN32)
 
@@ -146,7 +262,7 @@ void ProgramFail(struct ParseState *Parser, const char *Message, ...)
     PlatformPrintf(Parser->pc->CStdOut, "\n");
 
     va_start(Args, Message);
-    trace_write_error_msg(Parser->Line, Parser->CharacterPos, Message, Args);
+    trace_write_error_msg(Parser->pc, Parser->Line, Parser->CharacterPos, Message, Args);
     va_end(Args);
 
     PlatformExit(Parser->pc, 1);
@@ -195,6 +311,11 @@ void LexFail(Picoc *pc, struct LexState *Lexer, const char *Message, ...)
     PlatformVPrintf(pc->CStdOut, Message, Args);
     va_end(Args);
     PlatformPrintf(pc->CStdOut, "\n");
+
+    va_start(Args, Message);
+    trace_write_error_msg(pc, Lexer->Line, Lexer->CharacterPos, Message, Args);
+    va_end(Args);
+
     PlatformExit(pc, 1);
 }
 
@@ -19,15 +19,24 @@
 #define ALIGN_TYPE void *                   /* the default data type to use for alignment */
 #endif
 
-#define GLOBAL_TABLE_SIZE 97                /* global variable table */
-#define STRING_TABLE_SIZE 97                /* shared string table size */
-#define STRING_LITERAL_TABLE_SIZE 97        /* string literal table size */
-#define RESERVED_WORD_TABLE_SIZE 97         /* reserved word table size */
+/* table sizes must be powers of two */
+#define GLOBAL_TABLE_SIZE 128               /* global variable table (can expand) */
+#define STRING_TABLE_SIZE 512               /* shared string table size */
+#define STRING_LITERAL_TABLE_SIZE 128       /* string literal table size */
 #define PARAMETER_MAX 16                    /* maximum number of parameters to a function */
 #define LINEBUFFER_MAX 256                  /* maximum number of characters on a line */
-#define LOCAL_TABLE_SIZE 11                 /* size of local variable table (can expand) */
-#define STRUCT_TABLE_SIZE 11                /* size of struct/union member table (can expand) */
+#define LOCAL_TABLE_SIZE 16                 /* size of local variable table (can expand) */
+#define STRUCT_TABLE_SIZE 16                /* size of struct/union member table (can expand) */
+#define TYPE_TABLE_SIZE 64                  /* size of the type intern table (can expand) */
+#define MEMBER_CACHE_SIZE 256               /* number of resolved struct member references to remember */
+#define STATIC_CACHE_SIZE 64                /* number of resolved static variable declarations to remember */
+#define INITIALISER_IMAGE_TABLE_SIZE 64     /* hash size for constant array initialiser images - must be a power of two */
 #define MAX_MALLOCS 256
+#define CSTACK_MAX (64*1024*1024)           /* assume no more C stack than this if we can't find out */
+#define CSTACK_MARGIN (256*1024)            /* C stack kept in reserve for error handling */
+#define CSTACK_PER_STACK 4                  /* bytes of C stack to give the interpreter for each byte of its own stack */
+#define STACK_SEGMENT_SIZE (16*1024)        /* a segmented stack grows this much at a time */
+#define STACK_SEGMENT_POOL 4                /* spare stack segments kept for reuse */
 
 #define INTERACTIVE_PROMPT_START "starting picoc " PICOC_VERSION "\n"
 #define INTERACTIVE_PROMPT_STATEMENT "picoc> "
@@ -37,6 +46,7 @@
 #ifdef UNIX_HOST
 # define USE_MALLOC_STACK                   /* stack is allocated using malloc() */
 # define USE_MALLOC_HEAP                    /* heap is allocated using malloc() */
+# define USE_STACK_SEGMENTS                 /* stack grows in malloc()ed segments as it's needed */
 # include <stdio.h>
 # include <stdlib.h>
 # include <ctype.h>
@@ -47,6 +57,10 @@
 # include <unistd.h>
 # include <stdarg.h>
 # include <setjmp.h>
+# if defined(__SSE2__) && defined(__OPTIMIZE__)
+#  include <emmintrin.h>
+#  define USE_SSE2_LEXER                    /* the lexer scans source 16 characters at a time */
+# endif
 # ifndef NO_FP
 #  include <math.h>
 #  define PICOC_MATH_LIBRARY
@@ -63,6 +77,7 @@ extern jmp_buf ExitBuf;
 # ifdef WIN32
 #  define USE_MALLOC_STACK                   /* stack is allocated using malloc() */
 #  define USE_MALLOC_HEAP                    /* heap is allocated using malloc() */
+#  define USE_STACK_SEGMENTS                 /* stack grows in malloc()ed segments as it's needed */
 #  include <stdio.h>
 #  include <stdlib.h>
 #  include <ctype.h>
@@ -0,0 +1,560 @@
+/* picoc embedding - runs a program from inside another program, capturing
+ * its output, trace and errors in memory rather than in files */
+
+#include "../picoc.h"
+#include "../interpreter.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PICOC_RUN_STACK_SIZE (8*1024*1024)      /* the default for the most the stack can grow to */
+#define PICOC_RUN_FILE_NAME "source.c"
+
+/* split an error written by trace_write_error_msg() - the line, the column,
+ * then the message, each on a line of its own */
+static void PicocRunGetError(struct PicocResult *Result, const char *Error)
+{
+    char *End;
+
+    Result->Failed = TRUE;
+    Result->ErrorLine = strtol(Error, &End, 10);
+    if (*End == '\n')
+        Result->ErrorColumn = strtol(End + 1, &End, 10);
+
+    if (*End == '\n')
+        End++;
+
+    Result->ErrorMessage = strdup(End);
+}
+
+/* the in-memory streams a program runs with */
+struct PicocRunStreams
+{
+    FILE *In;
+    FILE *Out;
+    FILE *Err;
+    FILE *Error;
+    FILE *Trace;
+    char *ErrBuffer;
+    size_t ErrSize;
+    char *ErrorBuffer;
+    size_t ErrorSize;
+};
+
+/* close the streams a program ran with, leaving what was written to them in
+ * Result */
+static void PicocRunCloseStreams(Picoc *pc, struct PicocRunStreams *Streams, struct PicocResult *Result)
+{
+    /* closing the memory streams leaves their buffers for us */
+    if (Streams->In != NULL)
+        fclose(Streams->In);
+
+    if (Streams->Out != NULL)
+        fclose(Streams->Out);
+
+    if (Streams->Err != NULL)
+        fclose(Streams->Err);
+
+    if (Streams->Error != NULL)
+        fclose(Streams->Error);
+
+    if (Streams->Trace != NULL)
+        fclose(Streams->Trace);
+
+    Result->Stdout = pc->OutputBuffer;
+    Result->StdoutLen = pc->OutputSize;
+    Result->Stderr = Streams->ErrBuffer;
+    Result->StderrLen = Streams->ErrSize;
+    Result->Trace = pc->TraceBuffer;
+    Result->TraceLen = pc->TraceSize;
+    if (Streams->ErrorSize > 0)
+        PicocRunGetError(Result, Streams->ErrorBuffer);
+
+    free(Streams->ErrorBuffer);
+    pc->OutputBuffer = NULL;
+    pc->TraceBuffer = NULL;
+    pc->StdinValue = stdin;
+    pc->StdoutValue = stdout;
+    pc->CStdOut = stdout;
+    pc->StderrValue = stderr;
+    pc->ErrorStream = NULL;
+    pc->TraceStream = NULL;
+}
+
+/* give a program in-memory streams to run with. returns FALSE if they can't
+ * be opened, in which case they still have to be closed */
+static int PicocRunOpenStreams(Picoc *pc, struct PicocRunStreams *Streams, const char *Stdin, int StdinLen, int Trace)
+{
+    memset(Streams, '\0', sizeof(*Streams));
+    if (Stdin != NULL && StdinLen > 0)
+        Streams->In = fmemopen((void *)Stdin, StdinLen, "r");
+    else
+        Streams->In = fopen("/dev/null", "r");
+
+    Streams->Out = open_memstream(&pc->OutputBuffer, &pc->OutputSize);
+    Streams->Err = open_memstream(&Streams->ErrBuffer, &Streams->ErrSize);
+    Streams->Error = open_memstream(&Streams->ErrorBuffer, &Streams->ErrorSize);
+    if (Trace)
+        Streams->Trace = open_memstream(&pc->TraceBuffer, &pc->TraceSize);
+
+    if (Streams->In == NULL || Streams->Out == NULL || Streams->Err == NULL || Streams->Error == NULL || (Trace && Streams->Trace == NULL))
+        return FALSE;
+
+    pc->StdinValue = Streams->In;
+    pc->StdoutValue = Streams->Out;
+    pc->CStdOut = Streams->Out;
+    pc->StderrValue = Streams->Err;
+    pc->ErrorStream = Streams->Error;
+    pc->TraceStream = Streams->Trace;
+    return TRUE;
+}
+
+/* make a new interpreter with a copy of the source to parse in its heap */
+static Picoc *PicocRunStart(const char *Source, int SourceLen, const struct PicocRunOptions *Options, char **SourceCopy)
+{
+    Picoc *pc = malloc(sizeof(Picoc));
+
+    if (pc == NULL)
+        return NULL;
+
+    PicocInitialise(pc, (Options != NULL && Options->StackSize > 0) ? Options->StackSize : PICOC_RUN_STACK_SIZE);
+    *SourceCopy = HeapAllocMemUninitialised(pc, SourceLen + 1);
+    if (*SourceCopy == NULL)
+    {
+        PicocCleanup(pc);
+        free(pc);
+        return NULL;
+    }
+
+    memcpy(*SourceCopy, Source, SourceLen);
+    (*SourceCopy)[SourceLen] = '\0';
+    return pc;
+}
+
+/* the arguments to PicocRun() or PicocRunInputs(), for the thread they run on */
+struct PicocRunCall
+{
+    const char *Source;
+    int SourceLen;
+    const struct PicocRunOptions *Options;
+    struct PicocResult *Result;
+    int NumInputs;
+    const char **Inputs;
+    const int *InputLens;
+    PicocRunDone *Done;
+    void *Arg;
+};
+
+/* run the interpreter on a C stack sized to go with its own stack */
+static int PicocRunOnStack(int (*Func)(void *), struct PicocRunCall *Call)
+{
+    const struct PicocRunOptions *Options = Call->Options;
+
+    return PicocPlatformRunOnStack((Options != NULL && Options->StackSize > 0) ? Options->StackSize : PICOC_RUN_STACK_SIZE, Func, Call);
+}
+
+/* PicocRun() on the thread it runs on */
+static int PicocRunProgram(void *Arg)
+{
+    static char *NoArgs[1] = { NULL };
+    struct PicocRunCall *Call = Arg;
+    const char *Source = Call->Source;
+    int SourceLen = Call->SourceLen;
+    const struct PicocRunOptions *Options = Call->Options;
+    struct PicocResult *Result = Call->Result;
+    struct PicocRunStreams Streams;
+    char *SourceCopy;
+    int Ran = FALSE;
+    Picoc *pc;
+
+    memset(Result, '\0', sizeof(*Result));
+    pc = PicocRunStart(Source, SourceLen, Options, &SourceCopy);
+    if (pc == NULL)
+        return FALSE;
+
+    if (PicocRunOpenStreams(pc, &Streams, Options != NULL ? Options->Stdin : NULL, Options != NULL ? Options->StdinLen : 0, Options != NULL && Options->Trace))
+    {
+        if (!PicocPlatformSetExitPoint(pc))
+        {
+            PicocParse(pc, (Options != NULL && Options->FileName != NULL) ? Options->FileName : PICOC_RUN_FILE_NAME, SourceCopy, SourceLen, TRUE, FALSE, TRUE, TRUE);
+            PicocCallMain(pc, 0, NoArgs);
+        }
+
+        Result->ExitValue = pc->PicocExitValue;
+        Ran = TRUE;
+    }
+    else
+        HeapFreeMem(pc, SourceCopy);
+
+    PicocRunCloseStreams(pc, &Streams, Result);
+    PicocCleanup(pc);
+    free(pc);
+
+    if (!Ran)
+        PicocResultFree(Result);
+
+    return Ran;
+}
+
+/* run a program in a new interpreter and collect what happened. returns FALSE
+ * if it couldn't be run at all, otherwise the results are in Result and must
+ * be freed with PicocResultFree() */
+int PicocRun(const char *Source, int SourceLen, const struct PicocRunOptions *Options, struct PicocResult *Result)
+{
+    struct PicocRunCall Call;
+
+    memset(&Call, '\0', sizeof(Call));
+    Call.Source = Source;
+    Call.SourceLen = SourceLen;
+    Call.Options = Options;
+    Call.Result = Result;
+    return PicocRunOnStack(&PicocRunProgram, &Call);
+}
+
+#ifdef USE_MALLOC_HEAP
+/* copy a buffer from a result, keeping the null terminator the streams leave */
+static char *PicocResultCopyBuffer(const char *Buffer, size_t Len)
+{
+    char *Copy;
+
+    if (Buffer == NULL)
+        return NULL;
+
+    Copy = malloc(Len + 1);
+    if (Copy != NULL)
+        memcpy(Copy, Buffer, Len + 1);
+
+    return Copy;
+}
+
+/* run main() with one of the inputs to a parsed program */
+static void PicocRunInput(Picoc *pc, struct PicocResult *Parse, const char *Input, int InputLen, int Trace, struct PicocResult *Result)
+{
+    static char *NoArgs[1] = { NULL };
+    struct PicocRunStreams Streams;
+
+    if (PicocRunOpenStreams(pc, &Streams, Input, InputLen, Trace))
+    {
+        fwrite(Parse->Stdout, 1, Parse->StdoutLen, Streams.Out);
+        fwrite(Parse->Stderr, 1, Parse->StderrLen, Streams.Err);
+        if (Trace)
+            fwrite(Parse->Trace, 1, Parse->TraceLen, Streams.Trace);
+
+        if (!PicocPlatformSetExitPoint(pc))
+            PicocCallMain(pc, 0, NoArgs);
+    }
+
+    Result->ExitValue = pc->PicocExitValue;
+    PicocRunCloseStreams(pc, &Streams, Result);
+}
+
+/* what a forked child sends back ahead of the buffers in its result. each
+ * buffer is sent with the null terminator the streams leave, and a length of
+ * 0 means there's no buffer at all */
+struct PicocRunReply
+{
+    int ExitValue;
+    int Failed;
+    int ErrorLine;
+    int ErrorColumn;
+    size_t StdoutLen;
+    size_t StderrLen;
+    size_t TraceLen;
+    size_t ErrorMessageLen;
+};
+
+/* write all of a buffer to a pipe. returns FALSE if it can't */
+static int PicocRunWrite(int Fd, const void *Data, size_t Len)
+{
+    const char *Pos = Data;
+    ssize_t Written;
+
+    while (Len > 0)
+    {
+        Written = write(Fd, Pos, Len);
+        if (Written < 0 && errno == EINTR)
+            continue;
+
+        if (Written <= 0)
+            return FALSE;
+
+        Pos += Written;
+        Len -= Written;
+    }
+
+    return TRUE;
+}
+
+/* send a result from a forked child to its parent */
+static int PicocRunWriteReply(int Fd, struct PicocResult *Result)
+{
+    struct PicocRunReply Reply;
+
+    memset(&Reply, '\0', sizeof(Reply));
+    Reply.ExitValue = Result->ExitValue;
+    Reply.Failed = Result->Failed;
+    Reply.ErrorLine = Result->ErrorLine;
+    Reply.ErrorColumn = Result->ErrorColumn;
+    Reply.StdoutLen = Result->Stdout != NULL ? Result->StdoutLen + 1 : 0;
+    Reply.StderrLen = Result->Stderr != NULL ? Result->StderrLen + 1 : 0;
+    Reply.TraceLen = Result->Trace != NULL ? Result->TraceLen + 1 : 0;
+    Reply.ErrorMessageLen = Result->ErrorMessage != NULL ? strlen(Result->ErrorMessage) + 1 : 0;
+
+    return PicocRunWrite(Fd, &Reply, sizeof(Reply)) &&
+        PicocRunWrite(Fd, Result->Stdout, Reply.StdoutLen) &&
+        PicocRunWrite(Fd, Result->Stderr, Reply.StderrLen) &&
+        PicocRunWrite(Fd, Result->Trace, Reply.TraceLen) &&
+        PicocRunWrite(Fd, Result->ErrorMessage, Reply.ErrorMessageLen);
+}
+
+/* read one of the buffers in a reply. returns FALSE if the reply's too short */
+static int PicocRunReadBuffer(const char **Pos, const char *End, size_t Len, char **Buffer, size_t *BufferLen)
+{
+    if ((size_t)(End - *Pos) < Len)
+        return FALSE;
+
+    if (Len > 0)
+    {
+        *Buffer = PicocResultCopyBuffer(*Pos, Len - 1);
+        if (BufferLen != NULL)
+            *BufferLen = Len - 1;
+    }
+
+    *Pos += Len;
+    return TRUE;
+}
+
+/* read everything a forked child sent back and turn it into a result.
+ * returns FALSE if the child didn't send a whole reply */
+static int PicocRunReadReply(int Fd, struct PicocResult *Result)
+{
+    struct PicocRunReply Reply;
+    FILE *Stream;
+    char *Data = NULL;
+    size_t DataLen = 0;
+    char Buffer[4096];
+    const char *Pos;
+    const char *End;
+    ssize_t Got;
+    int Ok = FALSE;
+
+    Stream = open_memstream(&Data, &DataLen);
+    if (Stream == NULL)
+        return FALSE;
+
+    while ((Got = read(Fd, Buffer, sizeof(Buffer))) != 0)
+    {
+        if (Got < 0 && errno == EINTR)
+            continue;
+
+        if (Got < 0)
+            break;
+
+        fwrite(Buffer, 1, Got, Stream);
+    }
+
+    fclose(Stream);
+    if (DataLen >= sizeof(Reply))
+    {
+        memcpy(&Reply, Data, sizeof(Reply));
+        Pos = Data + sizeof(Reply);
+        End = Data + DataLen;
+        Result->ExitValue = Reply.ExitValue;
+        Result->Failed = Reply.Failed;
+        Result->ErrorLine = Reply.ErrorLine;
+        Result->ErrorColumn = Reply.ErrorColumn;
+        Ok = PicocRunReadBuffer(&Pos, End, Reply.StdoutLen, &Result->Stdout, &Result->StdoutLen) &&
+            PicocRunReadBuffer(&Pos, End, Reply.StderrLen, &Result->Stderr, &Result->StderrLen) &&
+            PicocRunReadBuffer(&Pos, End, Reply.TraceLen, &Result->Trace, &Result->TraceLen) &&
+            PicocRunReadBuffer(&Pos, End, Reply.ErrorMessageLen, &Result->ErrorMessage, NULL) &&
+            Pos == End;
+    }
+
+    free(Data);
+    return Ok;
+}
+
+/* run one input in a child forked from the parsed interpreter, which sends its
+ * result back to us through a pipe. the child is killed if it runs for more
+ * than TimeLimit seconds. if it crashes or runs out of time Result says so */
+static void PicocRunForkedInput(Picoc *pc, struct PicocResult *Parse, const char *Input, int InputLen, int Trace, int TimeLimit, struct PicocResult *Result)
+{
+    char Message[64];
+    int Fds[2];
+    pid_t Child = -1;
+    int Status = 0;
+    int Replied;
+
+    fflush(stdout);
+    fflush(stderr);
+    if (pipe(Fds) == 0)
+    {
+        Child = fork();
+        if (Child == 0)
+        {
+            close(Fds[0]);
+
+            /* the alarm's default action kills us if we run out of time */
+            signal(SIGALRM, SIG_DFL);
+            alarm(TimeLimit > 0 ? TimeLimit : 0);
+            PicocRunInput(pc, Parse, Input, InputLen, Trace, Result);
+            alarm(0);
+            _exit(PicocRunWriteReply(Fds[1], Result) ? 0 : 1);
+        }
+
+        close(Fds[1]);
+        Replied = Child > 0 && PicocRunReadReply(Fds[0], Result);
+        close(Fds[0]);
+        if (Child > 0)
+        {
+            while (waitpid(Child, &Status, 0) < 0)
+            {
+                if (errno != EINTR)
+                {
+                    Status = 0;
+                    break;
+                }
+            }
+
+            if (Replied && WIFEXITED(Status) && WEXITSTATUS(Status) == 0)
+                return;
+        }
+    }
+
+    PicocResultFree(Result);
+    if (Child < 0)
+        strcpy(Message, "can't fork");
+    else if (!WIFSIGNALED(Status))
+        strcpy(Message, "can't get the result");
+    else
+    {
+        if (WTERMSIG(Status) == SIGALRM && TimeLimit > 0)
+            sprintf(Message, "ran for more than %d second%s", TimeLimit, TimeLimit == 1 ? "" : "s");
+        else
+            sprintf(Message, "killed by signal %d", WTERMSIG(Status));
+
+        Result->ExitValue = 128 + WTERMSIG(Status);
+    }
+
+    Result->Failed = TRUE;
+    Result->ErrorMessage = strdup(Message);
+}
+
+/* PicocRunInputs() on the thread it runs on */
+static int PicocRunAllInputs(void *Arg)
+{
+    struct PicocRunCall *Call = Arg;
+    const char *Source = Call->Source;
+    int SourceLen = Call->SourceLen;
+    const struct PicocRunOptions *Options = Call->Options;
+    int NumInputs = Call->NumInputs;
+    const char **Inputs = Call->Inputs;
+    const int *InputLens = Call->InputLens;
+    PicocRunDone *Done = Call->Done;
+    struct PicocRunStreams Streams;
+    struct PicocResult Parse;
+    struct PicocResult Result;
+    int Trace = Options != NULL && Options->Trace;
+    int Parsed = FALSE;
+    int Going = TRUE;
+    char *SourceCopy;
+    int Count;
+    Picoc *pc;
+
+    memset(&Parse, '\0', sizeof(Parse));
+    pc = PicocRunStart(Source, SourceLen, Options, &SourceCopy);
+    if (pc == NULL)
+        return FALSE;
+
+    if (!PicocRunOpenStreams(pc, &Streams, NULL, 0, Trace))
+    {
+        HeapFreeMem(pc, SourceCopy);
+        PicocRunCloseStreams(pc, &Streams, &Parse);
+        PicocResultFree(&Parse);
+        PicocCleanup(pc);
+        free(pc);
+        return FALSE;
+    }
+
+    if (!PicocPlatformSetExitPoint(pc))
+    {
+        PicocParse(pc, (Options != NULL && Options->FileName != NULL) ? Options->FileName : PICOC_RUN_FILE_NAME, SourceCopy, SourceLen, TRUE, FALSE, TRUE, TRUE);
+        PicocSetResetPoint(pc);
+        Parsed = TRUE;
+    }
+
+    Parse.ExitValue = pc->PicocExitValue;
+    PicocRunCloseStreams(pc, &Streams, &Parse);
+    for (Count = 0; Count < NumInputs && Going; Count++)
+    {
+        memset(&Result, '\0', sizeof(Result));
+        if (!Parsed)
+        {
+            /* the parse failed or exited so there's nothing to run */
+            Result.ExitValue = Parse.ExitValue;
+            Result.Stdout = PicocResultCopyBuffer(Parse.Stdout, Parse.StdoutLen);
+            Result.StdoutLen = Parse.StdoutLen;
+            Result.Stderr = PicocResultCopyBuffer(Parse.Stderr, Parse.StderrLen);
+            Result.StderrLen = Parse.StderrLen;
+            Result.Trace = PicocResultCopyBuffer(Parse.Trace, Parse.TraceLen);
+            Result.TraceLen = Parse.TraceLen;
+            Result.Failed = Parse.Failed;
+            Result.ErrorLine = Parse.ErrorLine;
+            Result.ErrorColumn = Parse.ErrorColumn;
+            Result.ErrorMessage = Parse.ErrorMessage != NULL ? strdup(Parse.ErrorMessage) : NULL;
+        }
+        else if (Options != NULL && Options->ForkEach)
+            PicocRunForkedInput(pc, &Parse, Inputs[Count], InputLens[Count], Trace, Options->TimeLimit, &Result);
+        else
+        {
+            PicocRunInput(pc, &Parse, Inputs[Count], InputLens[Count], Trace, &Result);
+            PicocReset(pc);
+        }
+
+        Going = (*Done)(Count, &Result, Call->Arg);
+        PicocResultFree(&Result);
+    }
+
+    PicocResultFree(&Parse);
+    PicocCleanup(pc);
+    free(pc);
+    return Going;
+}
+
+/* parse a program once then run it with each of a list of inputs in turn,
+ * resetting the interpreter to just after the parse in between, or with
+ * Options->ForkEach running each in a child forked after the parse, which
+ * can be given a time limit. anything the parse itself wrote, such as the
+ * output of global initialisers, starts each result. if the parse fails every
+ * result is its failure. each result is handed to Done, on the thread the
+ * interpreter runs on, as soon as it's known and freed when Done returns, and
+ * Done returns FALSE to stop there. returns FALSE if it couldn't be run at
+ * all or Done stopped it */
+int PicocRunInputs(const char *Source, int SourceLen, const struct PicocRunOptions *Options, int NumInputs, const char **Inputs, const int *InputLens, PicocRunDone *Done, void *Arg)
+{
+    struct PicocRunCall Call;
+
+    memset(&Call, '\0', sizeof(Call));
+    Call.Source = Source;
+    Call.SourceLen = SourceLen;
+    Call.Options = Options;
+    Call.NumInputs = NumInputs;
+    Call.Inputs = Inputs;
+    Call.InputLens = InputLens;
+    Call.Done = Done;
+    Call.Arg = Arg;
+    return PicocRunOnStack(&PicocRunAllInputs, &Call);
+}
+#endif
+
+/* free the results of PicocRun() */
+void PicocResultFree(struct PicocResult *Result)
+{
+    free(Result->Stdout);
+    free(Result->Stderr);
+    free(Result->Trace);
+    free(Result->ErrorMessage);
+    memset(Result, '\0', sizeof(*Result));
+}
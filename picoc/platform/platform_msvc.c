@@ -12,6 +12,16 @@ void PlatformCleanup(Picoc *pc)
 {
 }
 
+void PlatformStackInit(Picoc *pc)
+{
+}
+
+/* there's no C stack limit to keep to here so just call it */
+int PicocPlatformRunOnStack(int StackSize, int (*Func)(void *), void *Arg)
+{
+    return (*Func)(Arg);
+}
+
 /* get a line of interactive input */
 char *PlatformGetLine(char *Buf, int MaxLen, const char *Prompt)
 {
@@ -47,7 +57,7 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
     
-    ReadText = malloc(FileInfo.st_size + 1);
+    ReadText = HeapAllocMemUninitialised(pc, FileInfo.st_size + 1);
     if (ReadText == NULL)
         ProgramFailNoParser(pc, "out of memory\n");
         
@@ -1,29 +1,38 @@
+#define _GNU_SOURCE     /* for pthread_getattr_np() */
 #include "../picoc.h"
 #include "../interpreter.h"
 
+#include <sys/resource.h>
+#include <pthread.h>
+
 #ifdef USE_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
 #endif
 
-/* mark where to end the program for platforms which require this */
-jmp_buf PicocExitBuf;
-
 #ifndef NO_DEBUGGER
 #include <signal.h>
 
-Picoc *break_pc = NULL;
+/* each thread breaks into its own interpreter. the break signal is delivered 
+ * to any thread which isn't blocking it, so threads which aren't running an 
+ * interpreter just ignore it */
+static __thread Picoc *break_pc = NULL;
 
 static void BreakHandler(int Signal)
 {
-    break_pc->DebugManualBreak = TRUE;
+    if (break_pc != NULL)
+        break_pc->DebugManualBreak = TRUE;
 }
 
 void PlatformInit(Picoc *pc)
 {
-    /* capture the break signal and pass it to the debugger */
+    struct sigaction Old;
+    
+    /* capture the break signal and pass it to the debugger, unless whoever's 
+     * running us handles it themselves */
     break_pc = pc;
-    signal(SIGINT, BreakHandler);
+    if (sigaction(SIGINT, NULL, &Old) == 0 && Old.sa_handler == SIG_DFL)
+        signal(SIGINT, BreakHandler);
 }
 #else
 void PlatformInit(Picoc *pc)
@@ -33,6 +42,101 @@ void PlatformInit(Picoc *pc)
 
 void PlatformCleanup(Picoc *pc)
 {
+#ifndef NO_DEBUGGER
+    /* the break signal can only go to one instance - stop sending it to this one */
+    if (break_pc == pc)
+        break_pc = NULL;
+#endif
+}
+
+/* interpreted function calls recurse on the C stack. set a limit a little 
+ * above the bottom of the stack of the thread we're running on so deep 
+ * recursion fails cleanly rather than crashing */
+void PlatformStackInit(Picoc *pc)
+{
+    pthread_attr_t Attr;
+    void *Low;
+    size_t Size;
+    struct rlimit Limit;
+    char Here;
+    
+    if (pthread_getattr_np(pthread_self(), &Attr) == 0)
+    {
+        int Got = pthread_attr_getstack(&Attr, &Low, &Size) == 0;
+        pthread_attr_destroy(&Attr);
+        
+        if (Got && (unsigned long)&Here > (unsigned long)Low && (unsigned long)&Here <= (unsigned long)Low + Size)
+        {
+            pc->CStackTop = (unsigned long)Low + Size;
+            Size = (unsigned long)&Here - (unsigned long)Low;
+            pc->CStackLimit = (unsigned long)Low + (Size > CSTACK_MARGIN * 2 ? CSTACK_MARGIN : Size / 2);
+            return;
+        }
+    }
+    
+    /* we can't find the thread's stack - assume we're near the top of one 
+     * which is as big as the stack limit allows */
+    if (getrlimit(RLIMIT_STACK, &Limit) != 0 || Limit.rlim_cur == RLIM_INFINITY || Limit.rlim_cur > CSTACK_MAX)
+        Size = CSTACK_MAX;
+    else
+        Size = Limit.rlim_cur;
+        
+    if (Size > CSTACK_MARGIN * 2)
+        Size -= CSTACK_MARGIN;
+    else
+        Size /= 2;
+    
+    pc->CStackTop = (unsigned long)&Here;
+    pc->CStackLimit = (unsigned long)&Here - Size;
+}
+
+/* a call for PicocPlatformRunOnStack() to make on its thread */
+struct PlatformStackCall
+{
+    int (*Func)(void *);
+    void *Arg;
+    int Result;
+};
+
+static void *PlatformStackThread(void *Arg)
+{
+    struct PlatformStackCall *Call = Arg;
+    
+    Call->Result = (*Call->Func)(Call->Arg);
+    return NULL;
+}
+
+/* interpreted function calls recurse on the C stack, so how deep a program
+ * can recurse depends on the stack of the thread it runs on as well as on
+ * StackSize. run Func on a thread of its own with a C stack big enough that
+ * StackSize is what runs out first, and wait for it to finish. if there's no
+ * such thread Func runs on this one, where the C stack limit still fails deep
+ * recursion cleanly */
+int PicocPlatformRunOnStack(int StackSize, int (*Func)(void *), void *Arg)
+{
+    struct PlatformStackCall Call;
+    pthread_attr_t Attr;
+    pthread_t Thread;
+    size_t Size = CSTACK_MAX;
+    int Started = FALSE;
+    
+    if (StackSize > 0 && (size_t)StackSize < ((size_t)-1 - CSTACK_MARGIN * 2) / CSTACK_PER_STACK)
+        Size = (size_t)StackSize * CSTACK_PER_STACK + CSTACK_MARGIN * 2;
+    
+    Call.Func = Func;
+    Call.Arg = Arg;
+    Call.Result = 0;
+    if (pthread_attr_init(&Attr) == 0)
+    {
+        Started = pthread_attr_setstacksize(&Attr, Size) == 0 && pthread_create(&Thread, &Attr, &PlatformStackThread, &Call) == 0;
+        pthread_attr_destroy(&Attr);
+    }
+    
+    if (!Started)
+        return (*Func)(Arg);
+    
+    pthread_join(Thread, NULL);
+    return Call.Result;
 }
 
 /* get a line of interactive input */
@@ -46,9 +150,10 @@ char *PlatformGetLine(char *Buf, int MaxLen, const char *Prompt)
         if (InLine == NULL)
             return NULL;
     
-        Buf[MaxLen] = '\0';
-        strncpy(Buf, InLine, MaxLen-1);
-        strncat(Buf, "\n", MaxLen-1);
+        /* leave room for the newline and the terminator */
+        strncpy(Buf, InLine, MaxLen-2);
+        Buf[MaxLen-2] = '\0';
+        strcat(Buf, "\n");
         
         if (InLine[0] != '\0')
             add_history(InLine);
@@ -90,7 +195,7 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
     
-    ReadText = malloc(FileInfo.st_size + 1);
+    ReadText = HeapAllocMemUninitialised(pc, FileInfo.st_size + 1);
     if (ReadText == NULL)
         ProgramFailNoParser(pc, "out of memory\n");
         
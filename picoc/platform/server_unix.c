@@ -0,0 +1,673 @@
+/* picoc job server - runs programs sent over a connection or a pipe instead of
+ * from the command line.
+ *
+ * requests and replies are a series of fields, each a line with the field name
+ * and the length of its data, then the data itself:
+ *
+ *     source 23\n
+ *     int main() { return 0; }
+ *
+ * a request can have these fields:
+ *     source   the program text
+ *     name     the file name to report errors against (default "source.c")
+ *     stdin    the program's standard input (default empty)
+ *     trace    the trace file name, as with "picoc -t". with --serve-stdio the
+ *              trace is sent back instead and the data is ignored
+ *     stack    the most the stack can grow to, in bytes (--serve-stdio only)
+ *     time     the most seconds the program can run for, 0 for no limit
+ *              (default 10)
+ *     run      ends the request, with no data
+ *
+ * the reply has the fields "stdout" and "stderr" with everything the program
+ * wrote, then "exit" with its exit value. if the request is bad the reply is
+ * just an "error" field.
+ *
+ * "picoc --grade" writes replies like those of --serve-stdio too, one for each
+ * of its input files, each starting with an "input" field naming the file. a
+ * run which crashes fails with "0 0 killed by signal N".
+ *
+ * with --zygote each connection carries one request, and a job which runs out
+ * of time gets just an "error" field saying so. with --serve-stdio the
+ * requests follow each other on stdin, and each reply also has "trace" if it
+ * was asked for and "failed" with "line column message" if the program failed,
+ * and ends with an "end" field with no data. each job runs in a child of its
+ * own, and one which crashes or runs out of time fails with "0 0 killed by
+ * signal N" or "0 0 ran for more than N seconds" */
+
+#include "../picoc.h"
+#include "../interpreter.h"
+#include "../trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVER_FIELD_NAME_MAX 32            /* the longest field name we accept */
+#define SERVER_BACKLOG 64                   /* connections waiting to be forked */
+#define SERVER_COPY_BUFFER 4096
+#define SERVER_TIME_LIMIT 10                /* seconds a job can run for unless it says otherwise, and a --grade input can run for */
+
+/* a job to run */
+struct ServerJob
+{
+    char *Source;
+    long SourceLen;
+    char *Name;
+    char *Stdin;
+    long StdinLen;
+    char *Trace;
+    char *Stack;
+    char *Time;
+};
+
+/* read exactly Len bytes, returning FALSE if the connection ends first */
+static int ServerRead(int Fd, char *Buf, long Len)
+{
+    long Got;
+
+    while (Len > 0)
+    {
+        Got = read(Fd, Buf, Len);
+        if (Got < 0 && errno == EINTR)
+            continue;
+
+        if (Got <= 0)
+            return FALSE;
+
+        Buf += Got;
+        Len -= Got;
+    }
+
+    return TRUE;
+}
+
+/* write all of a buffer */
+static int ServerWrite(int Fd, const char *Buf, long Len)
+{
+    long Put;
+
+    while (Len > 0)
+    {
+        Put = write(Fd, Buf, Len);
+        if (Put < 0 && errno == EINTR)
+            continue;
+
+        if (Put <= 0)
+            return FALSE;
+
+        Buf += Put;
+        Len -= Put;
+    }
+
+    return TRUE;
+}
+
+/* read the "name length\n" line which starts a field. the header is read a byte
+ * at a time so we never read past it into data which isn't ours. if the input
+ * ends before the header starts Name is left empty */
+static int ServerReadFieldHeader(int Fd, char *Name, long *Len)
+{
+    char Line[SERVER_FIELD_NAME_MAX + 24];
+    char *End;
+    int Pos = 0;
+
+    *Name = '\0';
+    do
+    {
+        if (Pos == sizeof(Line) - 1 || !ServerRead(Fd, &Line[Pos], 1))
+        {
+            if (Pos == 0)
+                return FALSE;
+
+            strcpy(Name, "?");
+            return FALSE;
+        }
+    } while (Line[Pos++] != '\n');
+
+    Line[Pos] = '\0';
+    End = strchr(Line, ' ');
+    if (End == NULL || End - Line > SERVER_FIELD_NAME_MAX)
+        return FALSE;
+
+    memcpy(Name, Line, End - Line);
+    Name[End - Line] = '\0';
+    *Len = strtol(End + 1, &End, 10);
+    return *End == '\n' && *Len >= 0;
+}
+
+/* read the data of a field into a new null-terminated buffer */
+static char *ServerReadFieldData(int Fd, long Len)
+{
+    char *Data = malloc(Len + 1);
+
+    if (Data == NULL || !ServerRead(Fd, Data, Len))
+    {
+        free(Data);
+        return NULL;
+    }
+
+    Data[Len] = '\0';
+    return Data;
+}
+
+/* write a field */
+static int ServerWriteField(int Fd, const char *Name, const char *Data, long Len)
+{
+    char Header[SERVER_FIELD_NAME_MAX + 24];
+
+    sprintf(Header, "%s %ld\n", Name, Len);
+    return ServerWrite(Fd, Header, strlen(Header)) && ServerWrite(Fd, Data, Len);
+}
+
+/* write the contents of a file as a field */
+static int ServerWriteFileField(int Fd, const char *Name, int FileFd)
+{
+    char Buf[SERVER_COPY_BUFFER];
+    long Len = lseek(FileFd, 0, SEEK_END);
+    long Got;
+    char Header[SERVER_FIELD_NAME_MAX + 24];
+
+    if (Len < 0 || lseek(FileFd, 0, SEEK_SET) < 0)
+        Len = 0;
+
+    sprintf(Header, "%s %ld\n", Name, Len);
+    if (!ServerWrite(Fd, Header, strlen(Header)))
+        return FALSE;
+
+    for (; Len > 0; Len -= Got)
+    {
+        Got = read(FileFd, Buf, Len < SERVER_COPY_BUFFER ? Len : SERVER_COPY_BUFFER);
+        if (Got <= 0)
+            break;
+
+        if (!ServerWrite(Fd, Buf, Got))
+            return FALSE;
+    }
+
+    /* pad it out if the file shrank under us so the reply stays in step */
+    memset(Buf, '\0', sizeof(Buf));
+    for (; Len > 0; Len -= Got)
+    {
+        Got = Len < SERVER_COPY_BUFFER ? Len : SERVER_COPY_BUFFER;
+        if (!ServerWrite(Fd, Buf, Got))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* free the parts of a job */
+static void ServerFreeJob(struct ServerJob *Job)
+{
+    free(Job->Source);
+    free(Job->Name);
+    free(Job->Stdin);
+    free(Job->Trace);
+    free(Job->Stack);
+    free(Job->Time);
+    memset(Job, '\0', sizeof(*Job));
+}
+
+/* read a job request up to its "run" field. on failure the message says why,
+ * or is NULL if the input ended cleanly before the request started */
+static int ServerReadJob(int Fd, struct ServerJob *Job, const char **Message)
+{
+    char Name[SERVER_FIELD_NAME_MAX + 1];
+    char **Field;
+    long Len;
+    int Started = FALSE;
+
+    memset(Job, '\0', sizeof(*Job));
+    for (;;)
+    {
+        if (!ServerReadFieldHeader(Fd, Name, &Len))
+        {
+            *Message = (Started || *Name != '\0') ? "bad request" : NULL;
+            break;
+        }
+
+        Started = TRUE;
+
+        if (strcmp(Name, "run") == 0)
+        {
+            if (Job->Source != NULL)
+                return TRUE;
+
+            *Message = "no source";
+            break;
+        }
+        else if (strcmp(Name, "source") == 0)
+        {
+            Field = &Job->Source;
+            Job->SourceLen = Len;
+        }
+        else if (strcmp(Name, "stdin") == 0)
+        {
+            Field = &Job->Stdin;
+            Job->StdinLen = Len;
+        }
+        else if (strcmp(Name, "name") == 0)
+            Field = &Job->Name;
+        else if (strcmp(Name, "trace") == 0)
+            Field = &Job->Trace;
+        else if (strcmp(Name, "stack") == 0)
+            Field = &Job->Stack;
+        else if (strcmp(Name, "time") == 0)
+            Field = &Job->Time;
+        else
+        {
+            *Message = "unknown field";
+            break;
+        }
+
+        free(*Field);
+        *Field = ServerReadFieldData(Fd, Len);
+        if (*Field == NULL)
+        {
+            *Message = "bad request";
+            break;
+        }
+    }
+
+    ServerFreeJob(Job);
+    return FALSE;
+}
+
+/* make a temporary file to stand in for one of the standard streams */
+static int ServerTempFd(int StdFd, const char *Data, long Len)
+{
+    FILE *Temp = tmpfile();
+    int Fd;
+
+    if (Temp == NULL)
+        return -1;
+
+    Fd = dup(fileno(Temp));
+    fclose(Temp);
+    if (Fd < 0)
+        return -1;
+
+    if ((Data != NULL && !ServerWrite(Fd, Data, Len)) || lseek(Fd, 0, SEEK_SET) < 0 || dup2(Fd, StdFd) < 0)
+    {
+        close(Fd);
+        return -1;
+    }
+
+    return Fd;
+}
+
+/* the reply a --zygote job's child sends if it runs out of time. it's made
+ * before the job starts so the alarm handler only has to write it */
+static int ServerTimeoutConnection = -1;
+static char ServerTimeoutReply[SERVER_FIELD_NAME_MAX + 64];
+static int ServerTimeoutReplyLen;
+
+/* the alarm handler for a --zygote job which has run out of time */
+static void ServerTimeout(int Signal)
+{
+    ServerWrite(ServerTimeoutConnection, ServerTimeoutReply, ServerTimeoutReplyLen);
+    shutdown(ServerTimeoutConnection, SHUT_WR);
+    _exit(1);
+}
+
+/* give a --zygote job's child an alarm which sends the timeout reply and
+ * stops it if the job runs for longer than it's allowed */
+static void ServerSetTimeLimit(int Connection, struct ServerJob *Job)
+{
+    int TimeLimit = Job->Time != NULL ? atoi(Job->Time) : SERVER_TIME_LIMIT;
+    char Message[48];
+
+    if (TimeLimit <= 0)
+        return;
+
+    sprintf(Message, "ran for more than %d second%s", TimeLimit, TimeLimit == 1 ? "" : "s");
+    sprintf(ServerTimeoutReply, "error %d\n%s", (int)strlen(Message), Message);
+    ServerTimeoutReplyLen = strlen(ServerTimeoutReply);
+    ServerTimeoutConnection = Connection;
+    signal(SIGALRM, ServerTimeout);
+    alarm(TimeLimit);
+}
+
+/* run a job in this process and send the results back. the streams of this
+ * process are taken over by the program, so this is done in a forked child */
+static void ServerRunJob(Picoc *pc, int Connection, struct ServerJob *Job)
+{
+    static char *NoArgs[1] = { NULL };
+    char ExitValue[24];
+    char *Source;
+    int StdoutFd = -1;
+    int StderrFd;
+
+    if (Job->Trace != NULL)
+    {
+        /* a traced program writes its output where the trace can pick it up */
+        trace_set_filename(pc, Job->Trace);
+        StdoutFd = open(trace_get_stdout_file(pc), O_RDWR | O_CREAT | O_TRUNC | O_SYNC, S_IRUSR | S_IWUSR);
+        if (StdoutFd < 0 || dup2(StdoutFd, 1) < 0)
+            StdoutFd = -1;
+    }
+    else
+        StdoutFd = ServerTempFd(1, NULL, 0);
+
+    StderrFd = ServerTempFd(2, NULL, 0);
+    if (StdoutFd < 0 || StderrFd < 0 || ServerTempFd(0, Job->Stdin, Job->StdinLen) < 0)
+    {
+        ServerWriteField(Connection, "error", "can't redirect streams", strlen("can't redirect streams"));
+        return;
+    }
+
+    Source = HeapAllocMemUninitialised(pc, Job->SourceLen + 1);
+    if (Source == NULL)
+    {
+        ServerWriteField(Connection, "error", "out of memory", strlen("out of memory"));
+        return;
+    }
+
+    memcpy(Source, Job->Source, Job->SourceLen + 1);
+    ServerSetTimeLimit(Connection, Job);
+    if (!PicocPlatformSetExitPoint(pc))
+    {
+        PicocParse(pc, Job->Name != NULL ? Job->Name : "source.c", Source, Job->SourceLen, TRUE, FALSE, TRUE, TRUE);
+        PicocCallMain(pc, 0, NoArgs);
+    }
+
+    /* the reply can't be cut short by the alarm once it's started */
+    alarm(0);
+    fflush(stdout);
+    fflush(stderr);
+    sprintf(ExitValue, "%d", pc->PicocExitValue);
+    if (ServerWriteFileField(Connection, "stdout", StdoutFd) && ServerWriteFileField(Connection, "stderr", StderrFd))
+        ServerWriteField(Connection, "exit", ExitValue, strlen(ExitValue));
+}
+
+/* read a job from a new connection and run it */
+static void ServerHandleConnection(Picoc *pc, int Connection)
+{
+    struct ServerJob Job;
+    const char *Message;
+    char Buf[SERVER_COPY_BUFFER];
+
+    if (ServerReadJob(Connection, &Job, &Message))
+    {
+        ServerRunJob(pc, Connection, &Job);
+        ServerFreeJob(&Job);
+    }
+    else if (Message != NULL)
+        ServerWriteField(Connection, "error", Message, strlen(Message));
+
+    /* end the reply and swallow whatever's left of a bad request, otherwise
+     * closing with unread data resets the connection before the client reads the reply */
+    shutdown(Connection, SHUT_WR);
+    while (recv(Connection, Buf, sizeof(Buf), MSG_DONTWAIT) > 0)
+    {}
+}
+
+/* serve jobs from a unix socket, forking a copy of this initialised interpreter
+ * to run each one. never returns */
+void PicocZygote(Picoc *pc, const char *SocketPath)
+{
+    struct sockaddr_un Address;
+    int Listener;
+    int Connection;
+    pid_t Child;
+
+    if (strlen(SocketPath) >= sizeof(Address.sun_path))
+        ProgramFailNoParser(pc, "socket path %s is too long", SocketPath);
+
+    memset(&Address, '\0', sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path, SocketPath);
+    unlink(SocketPath);
+
+    Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Listener < 0 || bind(Listener, (struct sockaddr *)&Address, sizeof(Address)) < 0 || listen(Listener, SERVER_BACKLOG) < 0)
+        ProgramFailNoParser(pc, "can't listen on %s", SocketPath);
+
+    /* nobody waits for the children so don't leave zombies behind */
+    signal(SIGCHLD, SIG_IGN);
+    fflush(stdout);
+    fflush(stderr);
+
+    for (;;)
+    {
+        Connection = accept(Listener, NULL, NULL);
+        if (Connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            ProgramFailNoParser(pc, "can't accept on %s", SocketPath);
+        }
+
+        Child = fork();
+        if (Child == 0)
+        {
+            close(Listener);
+            signal(SIGCHLD, SIG_DFL);
+            ServerHandleConnection(pc, Connection);
+            close(Connection);
+            _exit(0);
+        }
+
+        if (Child < 0)
+            ServerWriteField(Connection, "error", "can't fork", strlen("can't fork"));
+
+        close(Connection);
+    }
+}
+
+/* write what happened when a program ran, as the fields of a reply */
+static int ServerWriteResult(int Fd, struct PicocResult *Result)
+{
+    char *Failed;
+    char ExitValue[24];
+    int Ok;
+
+    Ok = ServerWriteField(Fd, "stdout", Result->Stdout, Result->StdoutLen) &&
+        ServerWriteField(Fd, "stderr", Result->Stderr, Result->StderrLen) &&
+        (Result->Trace == NULL || ServerWriteField(Fd, "trace", Result->Trace, Result->TraceLen));
+
+    if (Ok && Result->Failed)
+    {
+        Failed = malloc(strlen(Result->ErrorMessage) + 48);
+        if (Failed == NULL)
+            Ok = FALSE;
+        else
+        {
+            sprintf(Failed, "%d %d %s", Result->ErrorLine, Result->ErrorColumn, Result->ErrorMessage);
+            Ok = ServerWriteField(Fd, "failed", Failed, strlen(Failed));
+            free(Failed);
+        }
+    }
+
+    sprintf(ExitValue, "%d", Result->ExitValue);
+    return Ok && ServerWriteField(Fd, "exit", ExitValue, strlen(ExitValue));
+}
+
+/* run a job in a fresh interpreter in a forked child, with its output kept in
+ * memory, and send the results back on stdout. a job which crashes or runs for
+ * too long only takes the child with it and gets a failed reply */
+static int ServerRunStdioJob(struct ServerJob *Job, int StackSize)
+{
+    struct PicocRunOptions Options;
+    struct PicocResult Result;
+    int TimeLimit = Job->Time != NULL ? atoi(Job->Time) : SERVER_TIME_LIMIT;
+    char Message[64];
+    pid_t Child;
+    int Status;
+
+    memset(&Options, '\0', sizeof(Options));
+    Options.FileName = Job->Name;
+    Options.Stdin = Job->Stdin;
+    Options.StdinLen = Job->StdinLen;
+    Options.Trace = Job->Trace != NULL;
+    Options.StackSize = Job->Stack != NULL ? atoi(Job->Stack) : StackSize;
+
+    fflush(stdout);
+    fflush(stderr);
+    Child = fork();
+    if (Child == 0)
+    {
+        /* the alarm's default action kills us if we run out of time */
+        signal(SIGALRM, SIG_DFL);
+        alarm(TimeLimit > 0 ? TimeLimit : 0);
+        if (!PicocRun(Job->Source, Job->SourceLen, &Options, &Result))
+            _exit(ServerWriteField(1, "error", "can't run", strlen("can't run")) ? 0 : 1);
+
+        alarm(0);
+        _exit(ServerWriteResult(1, &Result) ? 0 : 1);
+    }
+
+    if (Child < 0)
+        return ServerWriteField(1, "error", "can't fork", strlen("can't fork"));
+
+    while (waitpid(Child, &Status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return FALSE;
+    }
+
+    if (WIFEXITED(Status))
+        return WEXITSTATUS(Status) == 0;
+
+    if (WTERMSIG(Status) == SIGALRM && TimeLimit > 0)
+        sprintf(Message, "ran for more than %d second%s", TimeLimit, TimeLimit == 1 ? "" : "s");
+    else
+        sprintf(Message, "killed by signal %d", WTERMSIG(Status));
+
+    memset(&Result, '\0', sizeof(Result));
+    Result.ExitValue = 128 + WTERMSIG(Status);
+    Result.Failed = TRUE;
+    Result.ErrorMessage = Message;
+    return ServerWriteResult(1, &Result);
+}
+
+/* serve jobs read from stdin one after another, each in a child of its own,
+ * until stdin ends. returns the process exit value */
+int PicocServeStdio(int StackSize)
+{
+    struct ServerJob Job;
+    const char *Message;
+    int Ok;
+
+    /* a reader which goes away shouldn't kill us half way through a reply */
+    signal(SIGPIPE, SIG_IGN);
+    for (;;)
+    {
+        if (!ServerReadJob(0, &Job, &Message))
+        {
+            if (Message == NULL)
+                return 0;
+
+            /* we can't find the start of the next request after a bad one */
+            ServerWriteField(1, "error", Message, strlen(Message));
+            ServerWriteField(1, "end", "", 0);
+            return 1;
+        }
+
+        Ok = ServerRunStdioJob(&Job, StackSize) && ServerWriteField(1, "end", "", 0);
+        ServerFreeJob(&Job);
+        if (!Ok)
+            return 1;
+    }
+}
+
+#ifdef USE_MALLOC_HEAP
+/* read a whole file into a new null-terminated buffer */
+static char *ServerReadFile(const char *FileName, long *Len)
+{
+    FILE *In = fopen(FileName, "rb");
+    char *Data = NULL;
+
+    if (In == NULL)
+        return NULL;
+
+    if (fseek(In, 0, SEEK_END) == 0 && (*Len = ftell(In)) >= 0 && fseek(In, 0, SEEK_SET) == 0)
+    {
+        Data = malloc(*Len + 1);
+        if (Data != NULL && fread(Data, 1, *Len, In) != (size_t)*Len)
+        {
+            free(Data);
+            Data = NULL;
+        }
+    }
+
+    fclose(In);
+    if (Data != NULL)
+        Data[*Len] = '\0';
+
+    return Data;
+}
+
+/* write the reply for one of the inputs to --grade */
+static int ServerGradeDone(int Input, struct PicocResult *Result, void *Arg)
+{
+    char **InputFiles = Arg;
+
+    return ServerWriteField(1, "input", InputFiles[Input], strlen(InputFiles[Input])) &&
+        ServerWriteResult(1, Result) && ServerWriteField(1, "end", "", 0);
+}
+
+/* run a program with each of a list of files as its stdin, parsing it only
+ * once. each input is run in a child forked after the parse so a crash or an
+ * endless loop only loses that one, and a reply like those from --serve-stdio is written to
+ * stdout for it as soon as it's done, starting with an "input" field giving
+ * the file name. returns the process exit value */
+int PicocGrade(const char *FileName, int NumInputs, char **InputFiles, int StackSize)
+{
+    struct PicocRunOptions Options;
+    const char **Inputs;
+    int *InputLens;
+    char *Source;
+    long SourceLen;
+    long Len;
+    int Count;
+    int Ok = FALSE;
+
+    Source = ServerReadFile(FileName, &SourceLen);
+    if (Source == NULL)
+    {
+        fprintf(stderr, "can't read file %s\n", FileName);
+        return 1;
+    }
+
+    Inputs = calloc(NumInputs + 1, sizeof(*Inputs));
+    InputLens = calloc(NumInputs + 1, sizeof(*InputLens));
+    if (Inputs == NULL || InputLens == NULL)
+        fprintf(stderr, "out of memory\n");
+    else
+    {
+        for (Count = 0; Count < NumInputs; Count++)
+        {
+            Inputs[Count] = ServerReadFile(InputFiles[Count], &Len);
+            if (Inputs[Count] == NULL)
+            {
+                fprintf(stderr, "can't read file %s\n", InputFiles[Count]);
+                break;
+            }
+
+            InputLens[Count] = Len;
+        }
+
+        memset(&Options, '\0', sizeof(Options));
+        Options.FileName = FileName;
+        Options.StackSize = StackSize;
+        Options.ForkEach = TRUE;
+        Options.TimeLimit = SERVER_TIME_LIMIT;
+        signal(SIGPIPE, SIG_IGN);
+        if (Count == NumInputs)
+            Ok = PicocRunInputs(Source, SourceLen, &Options, NumInputs, Inputs, InputLens, &ServerGradeDone, InputFiles);
+
+        for (Count = 0; Count < NumInputs; Count++)
+            free((void *)Inputs[Count]);
+    }
+
+    free(Inputs);
+    free(InputLens);
+    free(Source);
+    return Ok ? 0 : 1;
+}
+#endif
@@ -1,8 +1,15 @@
 /* picoc hash table module. This hash table code is used for both symbol tables
- * and the shared string table. */
+ * and the shared string table. 
+ *
+ * Tables use open addressing with linear probing. HashTable[] is an array of
+ * slots, each holding either NULL or a single entry. Sizes are powers of two
+ * and tables double in size when they pass TABLE_MAX_LOAD. */
  
 #include "interpreter.h"
 
+/* grow when Count / Size would exceed 3/4 */
+#define TABLE_MAX_LOAD(Count, Size) ((Count) * 4 > (Size) * 3)
+
 /* initialise the shared string system */
 void TableInit(Picoc *pc)
 {
@@ -10,46 +17,109 @@ void TableInit(Picoc *pc)
     pc->StrEmpty = TableStrRegister(pc, "");
 }
 
-/* hash function for strings */
+/* hash function for strings - 32 bit FNV-1a */
 static unsigned int TableHash(const char *Key, int Len)
 {
-    unsigned int Hash = Len;
-    int Offset;
+    unsigned int Hash = 2166136261u;
     int Count;
     
-    for (Count = 0, Offset = 8; Count < Len; Count++, Offset+=7)
+    for (Count = 0; Count < Len; Count++)
     {
-        if (Offset > sizeof(unsigned int) * 8 - 7)
-            Offset -= sizeof(unsigned int) * 8 - 6;
-            
-        Hash ^= *Key++ << Offset;
+        Hash ^= (unsigned char)*Key++;
+        Hash *= 16777619u;
     }
     
     return Hash;
 }
 
-/* initialise a table */
+/* hash function for shared string keys. shared strings have unique addresses 
+ * so we just mix the address bits. the low bits are always zero for aligned 
+ * allocations (and bit 0 is used to hide out-of-scope variables) so drop them */
+static unsigned int TableHashPointer(const char *Key)
+{
+    unsigned long Hash = ((unsigned long)Key) >> 3;
+    
+    Hash ^= Hash >> 16;
+    Hash *= 0x45d9f3bUL;
+    Hash ^= Hash >> 16;
+    
+    return (unsigned int)Hash;
+}
+
+/* initialise a table. Size must be a power of two */
 void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size, int OnHeap)
 {
     Tbl->Size = Size;
+    Tbl->Count = 0;
     Tbl->OnHeap = OnHeap;
+    Tbl->HashTableOnHeap = FALSE;
     Tbl->HashTable = HashTable;
     memset((void *)HashTable, '\0', sizeof(struct TableEntry *) * Size);
 }
 
+/* free a hash table slot array which has been grown onto the heap. the entries
+ * themselves are the caller's responsibility */
+void TableFreeHashTable(Picoc *pc, struct Table *Tbl)
+{
+    if (Tbl->HashTableOnHeap)
+    {
+        HeapFreeMem(pc, Tbl->HashTable);
+        Tbl->HashTable = NULL;
+        Tbl->HashTableOnHeap = FALSE;
+        Tbl->Size = 0;
+        Tbl->Count = 0;
+    }
+}
+
+/* double the size of a table and re-insert all the entries */
+static void TableGrow(Picoc *pc, struct Table *Tbl, int IsStringTable)
+{
+    int NewSize = Tbl->Size * 2;
+    struct TableEntry **NewHashTable = HeapAllocMem(pc, sizeof(struct TableEntry *) * NewSize);
+    struct TableEntry *Entry;
+    unsigned int Slot;
+    int Count;
+    
+    if (NewHashTable == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+    
+    for (Count = 0; Count < Tbl->Size; Count++)
+    {
+        Entry = Tbl->HashTable[Count];
+        if (Entry == NULL)
+            continue;
+        
+        Slot = (IsStringTable ? Entry->p.s.Hash : TableHashPointer(Entry->p.v.Key)) & (NewSize - 1);
+        while (NewHashTable[Slot] != NULL)
+            Slot = (Slot + 1) & (NewSize - 1);
+        
+        NewHashTable[Slot] = Entry;
+    }
+    
+    if (Tbl->HashTableOnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+    
+    Tbl->HashTable = NewHashTable;
+    Tbl->HashTableOnHeap = TRUE;
+    Tbl->Size = NewSize;
+}
+
 /* check a hash table entry for a key */
 static struct TableEntry *TableSearch(struct Table *Tbl, const char *Key, int *AddAt)
 {
     struct TableEntry *Entry;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
+    unsigned int Mask = Tbl->Size - 1;
+    unsigned int Slot = TableHashPointer(Key) & Mask;
     
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
+    while ((Entry = Tbl->HashTable[Slot]) != NULL)
     {
         if (Entry->p.v.Key == Key)
             return Entry;   /* found */
+        
+        Slot = (Slot + 1) & Mask;
     }
     
-    *AddAt = HashValue;    /* didn't find it in the chain */
+    *AddAt = Slot;    /* didn't find it - this is the first free slot */
     return NULL;
 }
 
@@ -62,14 +132,21 @@ int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val, const c
     
     if (FoundEntry == NULL)
     {   /* add it to the table */
-        struct TableEntry *NewEntry = VariableAlloc(pc, NULL, sizeof(struct TableEntry), Tbl->OnHeap);
+        struct TableEntry *NewEntry = VariableAllocUninitialised(pc, NULL, sizeof(struct TableEntry), Tbl->OnHeap);
         NewEntry->DeclFileName = DeclFileName;
         NewEntry->DeclLine = DeclLine;
         NewEntry->DeclColumn = DeclColumn;
         NewEntry->p.v.Key = Key;
         NewEntry->p.v.Val = Val;
-        NewEntry->Next = Tbl->HashTable[AddAt];
+        
+        if (TABLE_MAX_LOAD(Tbl->Count + 1, Tbl->Size))
+        {
+            TableGrow(pc, Tbl, FALSE);
+            TableSearch(Tbl, Key, &AddAt);
+        }
+        
         Tbl->HashTable[AddAt] = NewEntry;
+        Tbl->Count++;
         return TRUE;
     }
 
@@ -97,41 +174,59 @@ int TableGet(struct Table *Tbl, const char *Key, struct Value **Val, const char
     return TRUE;
 }
 
-/* remove an entry from the table */
+/* remove an entry from the table. the following entries in the probe
+ * sequence are shifted back so we never need tombstones */
 struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key)
 {
-    struct TableEntry **EntryPtr;
-    int HashValue = ((unsigned long)Key) % Tbl->Size;   /* shared strings have unique addresses so we don't need to hash them */
+    unsigned int Mask = Tbl->Size - 1;
+    unsigned int Slot = TableHashPointer(Key) & Mask;
+    unsigned int NextSlot;
+    unsigned int HomeSlot;
+    struct TableEntry *DeleteEntry;
+    struct Value *Val;
+    
+    while ((DeleteEntry = Tbl->HashTable[Slot]) != NULL && DeleteEntry->p.v.Key != Key)
+        Slot = (Slot + 1) & Mask;
+    
+    if (DeleteEntry == NULL)
+        return NULL;
     
-    for (EntryPtr = &Tbl->HashTable[HashValue]; *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->Next)
+    Val = DeleteEntry->p.v.Val;
+    HeapFreeMem(pc, DeleteEntry);
+    Tbl->HashTable[Slot] = NULL;
+    Tbl->Count--;
+    
+    for (NextSlot = (Slot + 1) & Mask; Tbl->HashTable[NextSlot] != NULL; NextSlot = (NextSlot + 1) & Mask)
     {
-        if ((*EntryPtr)->p.v.Key == Key)
+        /* move the entry back if its home slot isn't cyclically in (Slot, NextSlot] */
+        HomeSlot = TableHashPointer(Tbl->HashTable[NextSlot]->p.v.Key) & Mask;
+        if (((NextSlot - HomeSlot) & Mask) >= ((NextSlot - Slot) & Mask))
         {
-            struct TableEntry *DeleteEntry = *EntryPtr;
-            struct Value *Val = DeleteEntry->p.v.Val;
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
-
-            return Val;
+            Tbl->HashTable[Slot] = Tbl->HashTable[NextSlot];
+            Tbl->HashTable[NextSlot] = NULL;
+            Slot = NextSlot;
         }
     }
 
-    return NULL;
+    return Val;
 }
 
 /* check a hash table entry for an identifier */
-static struct TableEntry *TableSearchIdentifier(struct Table *Tbl, const char *Key, int Len, int *AddAt)
+static struct TableEntry *TableSearchIdentifier(struct Table *Tbl, const char *Key, int Len, unsigned int Hash, int *AddAt)
 {
     struct TableEntry *Entry;
-    int HashValue = TableHash(Key, Len) % Tbl->Size;
+    unsigned int Mask = Tbl->Size - 1;
+    unsigned int Slot = Hash & Mask;
     
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next)
+    while ((Entry = Tbl->HashTable[Slot]) != NULL)
     {
-        if (strncmp(&Entry->p.Key[0], (char *)Key, Len) == 0 && Entry->p.Key[Len] == '\0')
+        if (Entry->p.s.Hash == Hash && Entry->p.s.Len == Len && memcmp(&Entry->p.s.Key[0], Key, Len) == 0)
             return Entry;   /* found */
+        
+        Slot = (Slot + 1) & Mask;
     }
     
-    *AddAt = HashValue;    /* didn't find it in the chain */
+    *AddAt = Slot;    /* didn't find it - this is the first free slot */
     return NULL;
 }
 
@@ -139,21 +234,31 @@ static struct TableEntry *TableSearchIdentifier(struct Table *Tbl, const char *K
 char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident, int IdentLen)
 {
     int AddAt;
-    struct TableEntry *FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen, &AddAt);
+    unsigned int Hash = TableHash(Ident, IdentLen);
+    struct TableEntry *FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen, Hash, &AddAt);
     
     if (FoundEntry != NULL)
-        return &FoundEntry->p.Key[0];
+        return &FoundEntry->p.s.Key[0];
     else
     {   /* add it to the table - we economise by not allocating the whole structure here */
-        struct TableEntry *NewEntry = HeapAllocMem(pc, sizeof(struct TableEntry) - sizeof(union TableEntryPayload) + IdentLen + 1);
+        struct TableEntry *NewEntry = HeapAllocMemUninitialised(pc, sizeof(struct TableEntry) - sizeof(union TableEntryPayload) + sizeof(struct StringEntry) + IdentLen);
         if (NewEntry == NULL)
             ProgramFailNoParser(pc, "out of memory");
             
-        strncpy((char *)&NewEntry->p.Key[0], (char *)Ident, IdentLen);
-        NewEntry->p.Key[IdentLen] = '\0';
-        NewEntry->Next = Tbl->HashTable[AddAt];
+        memcpy((char *)&NewEntry->p.s.Key[0], Ident, IdentLen);
+        NewEntry->p.s.Key[IdentLen] = '\0';
+        NewEntry->p.s.Hash = Hash;
+        NewEntry->p.s.Len = IdentLen;
+        
+        if (TABLE_MAX_LOAD(Tbl->Count + 1, Tbl->Size))
+        {
+            TableGrow(pc, Tbl, TRUE);
+            TableSearchIdentifier(Tbl, Ident, IdentLen, Hash, &AddAt);
+        }
+        
         Tbl->HashTable[AddAt] = NewEntry;
-        return &NewEntry->p.Key[0];
+        Tbl->Count++;
+        return &NewEntry->p.s.Key[0];
     }
 }
 
@@ -171,16 +276,13 @@ char *TableStrRegister(Picoc *pc, const char *Str)
 /* free all the strings */
 void TableStrFree(Picoc *pc)
 {
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     int Count;
     
     for (Count = 0; Count < pc->StringTable.Size; Count++)
     {
-        for (Entry = pc->StringTable.HashTable[Count]; Entry != NULL; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
-        }
+        if (pc->StringTable.HashTable[Count] != NULL)
+            HeapFreeMem(pc, pc->StringTable.HashTable[Count]);
     }
+    
+    TableFreeHashTable(pc, &pc->StringTable);
 }
@@ -46,4 +46,8 @@ float g = 97;
 
 printf("%f %f\n", f, g);
 
+long h = 3;
+long i = 4;
+printf("%d %d %d %d\n", sizeof(1 + 2) == sizeof(int), (1 << 31) < 0, 2147483647 + 1 < 0, sizeof(h + i) == sizeof(int));
+
 void main() {}
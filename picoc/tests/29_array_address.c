@@ -5,4 +5,16 @@ char a[10];
 strcpy(a, "abcdef");
 printf("%s\n", &a[1]);
 
+int b[4];
+int *p;
+int n = 0;
+for (p = &b[0]; p != &b[4]; p++)
+    n++;
+printf("%d\n", n);
+
+int m[2][3];
+m[0][4] = 7;
+printf("%d %d\n", m[1][1], &m[1][3] == &m[0][0] + 6);
+printf("%d %d\n", sizeof(b[4]), sizeof(m[2]));
+
 void main() {}
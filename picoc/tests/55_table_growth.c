@@ -0,0 +1,96 @@
+#include <stdio.h>
+
+struct many
+{
+    int m0;
+    int m1;
+    int m2;
+    int m3;
+    int m4;
+    int m5;
+    int m6;
+    int m7;
+    int m8;
+    int m9;
+    int m10;
+    int m11;
+    int m12;
+    int m13;
+    int m14;
+    int m15;
+    int m16;
+    int m17;
+    int m18;
+    int m19;
+};
+
+int sum_locals()
+{
+    int v0 = 0;
+    int v1 = 1;
+    int v2 = 2;
+    int v3 = 3;
+    int v4 = 4;
+    int v5 = 5;
+    int v6 = 6;
+    int v7 = 7;
+    int v8 = 8;
+    int v9 = 9;
+    int v10 = 10;
+    int v11 = 11;
+    int v12 = 12;
+    int v13 = 13;
+    int v14 = 14;
+    int v15 = 15;
+    int v16 = 16;
+    int v17 = 17;
+    int v18 = 18;
+    int v19 = 19;
+    int v20 = 20;
+    int v21 = 21;
+    int v22 = 22;
+    int v23 = 23;
+    int total = 0;
+
+    {
+        int inner = 100;
+        total += inner;
+    }
+
+    total += v0 + v3 + v6 + v9 + v12 + v15 + v18 + v21;
+    total += v1 + v4 + v7 + v10 + v13 + v16 + v19 + v22;
+    total += v2 + v5 + v8 + v11 + v14 + v17 + v20 + v23;
+    return total;
+}
+
+void main()
+{
+    struct many s;
+    int i;
+
+    s.m0 = 0;
+    s.m1 = 1;
+    s.m2 = 4;
+    s.m3 = 9;
+    s.m4 = 16;
+    s.m5 = 25;
+    s.m6 = 36;
+    s.m7 = 49;
+    s.m8 = 64;
+    s.m9 = 81;
+    s.m10 = 100;
+    s.m11 = 121;
+    s.m12 = 144;
+    s.m13 = 169;
+    s.m14 = 196;
+    s.m15 = 225;
+    s.m16 = 256;
+    s.m17 = 289;
+    s.m18 = 324;
+    s.m19 = 361;
+
+    printf("%d %d %d\n", s.m0, s.m11, s.m19);
+    printf("%d\n", sum_locals());
+    for (i = 0; i < 3; i++)
+        printf("%d\n", sum_locals() + i);
+}
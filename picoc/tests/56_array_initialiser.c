@@ -0,0 +1,21 @@
+#include <stdio.h>
+int f(int k)
+{
+    int t[] = { 1, -2, 'a', -'b', 3.7, 2*3, (7), 1<<4 };
+    double d[4] = { 1, -2.5, 'c' };
+    char s[2][4] = { "ab", "cd" };
+    unsigned char u[3] = { -1, 256, 255 };
+    int m[2][3] = { {1,2,3}, {4,5} };
+    int v[3] = { k, k+1, 9 };
+    int i, sum = 0;
+    for (i = 0; i < 8; i++) sum += t[i];
+    for (i = 0; i < 3; i++) sum += v[i] + u[i];
+    t[0] = 100;
+    return sum + (int)d[1] + (int)d[2] + s[1][0] + m[1][1] + m[1][2] + (int)sizeof(t);
+}
+int main()
+{
+    int k;
+    for (k = 0; k < 3; k++) printf("%d\n", f(k));
+    return 0;
+}
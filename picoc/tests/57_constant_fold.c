@@ -0,0 +1,79 @@
+#include <stdio.h>
+
+#define N 10
+#define M (N*2+1)
+#define HALF 0.5
+#define SHIFT 3
+#define ZERO 0
+
+enum colour { RED, GREEN = 5, BLUE };
+
+struct node
+{
+    int value;
+    struct node *next;
+};
+
+typedef struct node node_t;
+
+int shadow(int RED)
+{
+    int GREEN = 3;
+    return GREEN + RED;
+}
+
+int shadow2()
+{
+    int a = 1, BLUE = 40;
+    return BLUE + a;
+}
+
+int label(int x)
+{
+    if (x) goto done;
+    x = 7;
+done:
+    return x;
+}
+
+int maybe_divide(int x)
+{
+    if (x != 0)
+        return N / x + N % 3;
+    return 0;
+}
+
+int main()
+{
+    int i;
+    long total = 0;
+    double d = HALF * N;
+    int a[M];
+    char c = 'a' + 2;
+    
+    for (i = 0; i < M; i++)
+    {
+        a[i] = i * N + 1;
+        total += a[i] - (N + 1);
+    }
+    
+    printf("%d %d %ld\n", M, N * 2 + 1, total);
+    printf("%f %f\n", d, N * HALF + 1);
+    printf("%d %d %d\n", RED, GREEN + 1, BLUE * 2);
+    i = sizeof(struct node);
+    printf("%d %d %d\n", i, sizeof(node_t) + sizeof(char **), sizeof(int) * N);
+    printf("%d %d\n", shadow(2), shadow2());
+    printf("%d %d\n", label(0), label(4));
+    printf("%d %d\n", maybe_divide(0), maybe_divide(4));
+    printf("%d %d %d\n", 1 << SHIFT, (N > 5) && (M < 30), -N);
+    printf("%c %d\n", c, sizeof(GREEN + 1));
+    switch (12)
+    {
+        case N + 2: printf("case N + 2\n"); break;
+        case N: printf("case N\n"); break;
+    }
+    i = ZERO ? N : M;
+    printf("%d\n", i);
+    N;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <stdio.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define SQUARE(x) ((x) * (x))
+#define SUMSQ(x, y) (SQUARE(x) + SQUARE(y))
+#define Y_PLUS(p, n) (p.y + (n))
+#define ADDX(a) ((a) + x)
+
+int x = 100;
+
+int addx_local()
+{
+    int x = 1;
+    return ADDX(5);
+}
+
+struct pt { int x; int y; };
+
+int main()
+{
+    int i;
+    int t = 0;
+    double d = 0;
+    struct pt p;
+    
+    p.x = 7;
+    p.y = 9;
+    for (i = 0; i < 100; i++)
+    {
+        t += MAX(i, 50) + SQUARE(i % 7);
+        d += MAX(i * 0.5, 20.0);
+    }
+    
+    printf("%d %f\n", t, d);
+    printf("%d %d\n", SUMSQ(3, 4), SUMSQ(MAX(1, 2), SQUARE(2)));
+    printf("%d\n", Y_PLUS(p, 3));
+    printf("%d\n", addx_local());
+    return 0;
+}
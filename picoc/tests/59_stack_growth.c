@@ -0,0 +1,41 @@
+#include <stdio.h>
+
+struct Block
+{
+    int Data[4000];
+};
+
+int Nest(int Depth)
+{
+    struct Block b;
+    int Result;
+    
+    b.Data[0] = Depth;
+    b.Data[3999] = Depth * 2;
+    if (Depth == 0)
+        return 0;
+    
+    Result = Nest(Depth - 1);
+    return Result + b.Data[3999] - b.Data[0];
+}
+
+int Count(int Depth)
+{
+    if (Depth == 0)
+        return 0;
+    
+    return Count(Depth - 1) + 1;
+}
+
+int main()
+{
+    int i;
+    
+    for (i = 0; i < 3; i++)
+        printf("%d\n", Nest(40));
+    
+    printf("%d\n", Count(2000));
+    printf("%d\n", Count(12000));
+    printf("%d\n", Nest(5));
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int Runs = 0;
+int Squares[] = { 0, 1, 4, 9 };
+
+int Count()
+{
+    static int Calls = 0;
+    
+    Calls++;
+    return Calls;
+}
+
+int main()
+{
+    int a;
+    int b;
+    int *Sum = malloc(sizeof(int));
+    
+    Runs++;
+    Squares[1] += 10;
+    scanf("%d %d", &a, &b);
+    *Sum = a + b;
+    printf("%d %d %d %d\n", *Sum, Runs, Squares[1], Count());
+    if (b == 0)
+        *(int *)16 = a;
+        
+    if (*Sum < 0)
+        exit(2);
+        
+    return 0;
+}
@@ -0,0 +1,11 @@
+int x = 5;
+int f(int a) { return a * 2; }
+int y = f(x);
+printf("%d\n", y);
+int g(int n) { int T = 0; int i; for (i = 0; i < n; i++) { T += i; }
+return T; }
+printf("%d %d\n", g(4), f(y));
+{ int Inner = 3; printf("%d\n", Inner + x); }
+printf("%d %d\n", x, y);
+int h(int v) { return abs(v) + strlen("ab"); }
+printf("%d %d\n", h(-3), abs(-4));
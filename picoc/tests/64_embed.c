@@ -0,0 +1,63 @@
+/* a host program using picoc as a library, built with nothing but libpicoc.h */
+#include <stdio.h>
+#include <string.h>
+
+#include "libpicoc.h"
+
+static void ShowResult(int Input, struct PicocResult *Result)
+{
+    printf("input %d exit %d\n", Input, Result->ExitValue);
+    fwrite(Result->Stdout, 1, Result->StdoutLen, stdout);
+    fwrite(Result->Stderr, 1, Result->StderrLen, stdout);
+    if (Result->Failed)
+        printf("failed %d %d %s\n", Result->ErrorLine, Result->ErrorColumn, Result->ErrorMessage);
+}
+
+static int Done(int Input, struct PicocResult *Result, void *Arg)
+{
+    ShowResult(Input, Result);
+    (*(int *)Arg)++;
+    return TRUE;
+}
+
+int main()
+{
+    static const char Doubler[] = "#include <stdio.h>\n\nint main()\n{\n    int n;\n    scanf(\"%d\", &n);\n    printf(\"%d\\n\", n * 2);\n    return n;\n}\n";
+    static const char Broken[] = "int main()\n{\n    return x;\n}\n";
+    static const char Blocks[] = "#include <stdio.h>\n#include <stdlib.h>\n\nint *Total = calloc(1, sizeof(int));\nint *Gone = malloc(sizeof(int));\nint *Grown = malloc(sizeof(int));\n*Gone = 7;\n*Grown = 3;\n\nint main()\n{\n    int n;\n    scanf(\"%d\", &n);\n    *Total += n;\n    Grown = realloc(Grown, 100 * sizeof(int));\n    Grown[99] = n;\n    printf(\"%d %d %d\\n\", *Total, *Gone, Grown[0]);\n    free(Gone);\n    free(Grown);\n    return 0;\n}\n";
+    static const char Looper[] = "#include <stdio.h>\n\nint main()\n{\n    int n;\n    scanf(\"%d\", &n);\n    printf(\"%d\\n\", n);\n    fprintf(stderr, \"to stderr\\n\");\n    while (n == 4)\n        ;\n    return n;\n}\n";
+    static const char *Inputs[] = { "21", "4", "1" };
+    static const int InputLens[] = { 2, 1, 1 };
+    struct PicocRunOptions Options;
+    struct PicocResult Result;
+    int Calls = 0;
+
+    memset(&Options, '\0', sizeof(Options));
+    Options.Stdin = "5";
+    Options.StdinLen = 1;
+    if (PicocRun(Doubler, strlen(Doubler), &Options, &Result))
+    {
+        ShowResult(0, &Result);
+        PicocResultFree(&Result);
+    }
+
+    if (PicocRun(Broken, strlen(Broken), NULL, &Result))
+    {
+        ShowResult(0, &Result);
+        PicocResultFree(&Result);
+    }
+
+    PicocRunInputs(Doubler, strlen(Doubler), NULL, 2, Inputs, InputLens, Done, &Calls);
+
+    /* blocks malloc()ed by the globals are put back as they were between inputs */
+    PicocRunInputs(Blocks, strlen(Blocks), NULL, 3, Inputs, InputLens, Done, &Calls);
+
+    /* forked inputs are stopped when they run out of time, and their results
+     * come back to be handed to Done here */
+    Options.Stdin = NULL;
+    Options.ForkEach = TRUE;
+    Options.TimeLimit = 1;
+    PicocRunInputs(Looper, strlen(Looper), &Options, 3, Inputs, InputLens, Done, &Calls);
+    printf("%d results\n", Calls);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* a host program which starts "picoc --zygote" and sends it jobs */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SOCKET_PATH "65_embed_zygote.sock"
+
+/* connect to the server, waiting for it to start listening */
+static int Connect()
+{
+    struct sockaddr_un Address;
+    int Tries;
+    int Fd;
+
+    memset(&Address, '\0', sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path, SOCKET_PATH);
+    for (Tries = 0; Tries < 100; Tries++)
+    {
+        Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (Fd >= 0 && connect(Fd, (struct sockaddr *)&Address, sizeof(Address)) == 0)
+            return Fd;
+
+        close(Fd);
+        usleep(50000);
+    }
+
+    return -1;
+}
+
+static void WriteField(int Fd, const char *Name, const char *Data)
+{
+    char Header[64];
+
+    sprintf(Header, "%s %d\n", Name, (int)strlen(Data));
+    if (write(Fd, Header, strlen(Header)) < 0 || write(Fd, Data, strlen(Data)) < 0)
+        printf("can't send %s\n", Name);
+}
+
+/* send a job and show the reply */
+static void RunJob(const char *Source, const char *Time)
+{
+    char Buf[256];
+    ssize_t Got;
+    int Fd = Connect();
+
+    if (Fd < 0)
+    {
+        printf("can't connect\n");
+        return;
+    }
+
+    WriteField(Fd, "source", Source);
+    if (Time != NULL)
+        WriteField(Fd, "time", Time);
+
+    WriteField(Fd, "run", "");
+    while ((Got = read(Fd, Buf, sizeof(Buf))) > 0)
+        fwrite(Buf, 1, Got, stdout);
+
+    printf("\n");
+    close(Fd);
+}
+
+int main()
+{
+    pid_t Server;
+
+    unlink(SOCKET_PATH);
+    fflush(stdout);
+    Server = fork();
+    if (Server == 0)
+    {
+        execl("../picoc", "picoc", "--zygote", SOCKET_PATH, (char *)NULL);
+        _exit(127);
+    }
+
+    RunJob("#include <stdio.h>\n\nint main()\n{\n    printf(\"hello\\n\");\n    return 2;\n}\n", NULL);
+    RunJob("int main()\n{\n    for (;;)\n        ;\n    return 0;\n}\n", "1");
+    RunJob("int main()\n{\n    return 3;\n}\n", NULL);
+
+    kill(Server, SIGTERM);
+    waitpid(Server, NULL, 0);
+    unlink(SOCKET_PATH);
+    return 0;
+}
@@ -6,13 +6,6 @@
 #include "trace.h"
 #define MAX_ARRAY_DIMENSIONS 3
 
-typedef struct TraceFiles {
-    const char *stdout_file;
-    const char *trace_file;
-} TraceFiles;
-
-TraceFiles TRACE_FILES;
-
 typedef enum {
     ARRAY_OBJECT,
     STRUCT_OBJECT,
@@ -48,45 +41,53 @@ typedef struct TraceVariable {
     union anyvalue v;
 } TraceVariable;
 
-void trace_set_filename(char *filename){
+void trace_set_filename(Picoc *pc, const char *filename){
     /*
      * stdout_file = filename + "_stdout"
      * trace_file = filename + "_trace"
      */
     char *stdout_file = NULL;
     char *trace_file = NULL;
+    free(pc->TraceStdoutFile);
+    free(pc->TraceFile);
     if (filename != NULL){
         stdout_file = malloc(sizeof(char) * (strlen(filename) + 8));
         trace_file = malloc(sizeof(char) * (strlen(filename) + 7));
         sprintf(stdout_file, "%s.stdout", filename);
         sprintf(trace_file, "%s.trace", filename);
     }
-    TRACE_FILES.stdout_file = stdout_file;
-    TRACE_FILES.trace_file = trace_file;
+    pc->TraceStdoutFile = stdout_file;
+    pc->TraceFile = trace_file;
 }
 
-const char *trace_get_stdout_file(){
-    return TRACE_FILES.stdout_file;
+const char *trace_get_stdout_file(Picoc *pc){
+    return pc->TraceStdoutFile;
 }
 
-const char *trace_get_trace_file(){
-    return TRACE_FILES.trace_file;
+const char *trace_get_trace_file(Picoc *pc){
+    return pc->TraceFile;
 }
 
-void write_to_trace(const char* json_output){
-    FILE *fp = fopen(trace_get_trace_file(), "a+");
+void write_to_trace(Picoc *pc, const char* json_output){
+    FILE *fp;
+    if (pc->TraceStream != NULL){
+        fprintf(pc->TraceStream, "%s\n", json_output);
+        return;
+    }
+    fp = fopen(trace_get_trace_file(pc), "a+");
     fprintf(fp, "%s\n", json_output);
     fclose(fp);
 }
 
-void trace_write_error_msg(int line, int charpos, const char *Format, va_list Args){
+void trace_write_error_msg(Picoc *pc, int line, int charpos, const char *Format, va_list Args){
 
     const char *FPos;
+    FILE *stderr_stream = pc->ErrorStream != NULL ? pc->ErrorStream : stderr;
 
-    PrintSimpleInt(line, stderr);
-    PrintCh('\n', stderr);
-    PrintSimpleInt(charpos, stderr);
-    PrintCh('\n', stderr);
+    PrintSimpleInt(line, stderr_stream);
+    PrintCh('\n', stderr_stream);
+    PrintSimpleInt(charpos, stderr_stream);
+    PrintCh('\n', stderr_stream);
 
     for (FPos = Format; *FPos != '\0'; FPos++)
     {
@@ -95,17 +96,17 @@ void trace_write_error_msg(int line, int charpos, const char *Format, va_list Ar
             FPos++;
             switch (*FPos)
             {
-            case 's': PrintStr(va_arg(Args, char *), stderr); break;
-            case 'd': PrintSimpleInt(va_arg(Args, int), stderr); break;
-            case 'c': PrintCh(va_arg(Args, int), stderr); break;
-            case 't': PrintType(va_arg(Args, struct ValueType *), stderr); break;
-            case 'f': PrintFP(va_arg(Args, double), stderr); break;
-            case '%': PrintCh('%', stderr); break;
+            case 's': PrintStr(va_arg(Args, char *), stderr_stream); break;
+            case 'd': PrintSimpleInt(va_arg(Args, int), stderr_stream); break;
+            case 'c': PrintCh(va_arg(Args, int), stderr_stream); break;
+            case 't': PrintType(va_arg(Args, struct ValueType *), stderr_stream); break;
+            case 'f': PrintFP(va_arg(Args, double), stderr_stream); break;
+            case '%': PrintCh('%', stderr_stream); break;
             case '\0': FPos--; break;
             }
         }
         else
-            PrintCh(*FPos, stderr);
+            PrintCh(*FPos, stderr_stream);
     }
 }
 
@@ -277,6 +278,21 @@ char *read_stdout(const char *file_name)
     return source;
 }
 
+char *read_captured_stdout(Picoc *pc)
+{
+    char *output;
+
+    fflush(pc->StdoutValue);
+    output = malloc(pc->OutputSize + 1);
+    if (output != NULL) {
+        if (pc->OutputSize > 0)
+            memcpy(output, pc->OutputBuffer, pc->OutputSize);
+        output[pc->OutputSize] = '\0';
+    }
+
+    return output;
+}
+
 json_t* get_stack_frames(json_t *address_dict, struct ParseState *parser)
 {
     int j;
@@ -301,9 +317,7 @@ json_t* get_stack_frames(json_t *address_dict, struct ParseState *parser)
         json_array_append_new(stack_frames, stack_frame);
 
         for(j=0; j<sf->LocalTable.Size; j++) {
-            for(te = sf->LocalTable.HashTable[j];
-                te != NULL;
-                te = te->Next){
+            if ((te = sf->LocalTable.HashTable[j]) != NULL) {
 
                 if (! te->p.v.Val->IsLValue)
                     continue;
@@ -318,9 +332,7 @@ json_t* get_stack_frames(json_t *address_dict, struct ParseState *parser)
     }
 
     for(j=0; j<parser->pc->GlobalTable.Size; j++){
-        for(te = parser->pc->GlobalTable.HashTable[j];
-            te != NULL;
-            te = te->Next){
+        if ((te = parser->pc->GlobalTable.HashTable[j]) != NULL) {
 
             if (! te->p.v.Val->IsLValue)
                 continue;
@@ -570,7 +582,7 @@ void trace_state_print(struct ParseState *parser)
     json_t *stack_frames, *stack_frame, *ordered_varnames, *encoded_locals, *heap;
     int i, stack_size, j;
 
-    if (!parser->pc->TopStackFrame || !trace_get_trace_file())
+    if (!parser->pc->TopStackFrame || (!trace_get_trace_file(parser->pc) && !parser->pc->TraceStream))
         return;
 
     object = json_object();
@@ -578,7 +590,10 @@ void trace_state_print(struct ParseState *parser)
     heap = json_object();
     address_dict = json_object();
     ordered_globals = json_array();
-    std_output = read_stdout(trace_get_stdout_file());
+    if (parser->pc->TraceStream != NULL)
+        std_output = read_captured_stdout(parser->pc);
+    else
+        std_output = read_stdout(trace_get_stdout_file(parser->pc));
 
     json_object_set_new(object, "line", json_integer(parser->Line));
     json_object_set_new(object, "event", json_string("step_line"));
@@ -598,9 +613,7 @@ void trace_state_print(struct ParseState *parser)
      * Store all globals.
      */
     for(j=0; j<parser->pc->GlobalTable.Size; j++){
-        for(te = parser->pc->GlobalTable.HashTable[j];
-            te != NULL;
-            te = te->Next){
+        if ((te = parser->pc->GlobalTable.HashTable[j]) != NULL) {
 
             if (! te->p.v.Val->IsLValue)
                 continue;
@@ -635,9 +648,7 @@ void trace_state_print(struct ParseState *parser)
         ordered_varnames = json_array();
 
         for(j=0; j<sf->LocalTable.Size; j++) {
-            for(te = sf->LocalTable.HashTable[j];
-                te != NULL;
-                te = te->Next){
+            if ((te = sf->LocalTable.HashTable[j]) != NULL) {
 
                 if (! te->p.v.Val->IsLValue)
                     continue;
@@ -679,7 +690,7 @@ void trace_state_print(struct ParseState *parser)
 
     json_output = json_dumps(object, 0);
     /*fprintf(stderr, "%s\n", json_output);*/
-    write_to_trace(json_output);
+    write_to_trace(parser->pc, json_output);
 
     free(json_output);
     free(std_output);
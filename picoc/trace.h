@@ -17,13 +17,13 @@
 extern "C" {
 #endif
 
-void trace_write_error_msg(int line, int charpos, const char *Fromat, va_list Args);
+void trace_write_error_msg(Picoc *pc, int line, int charpos, const char *Fromat, va_list Args);
 
-void trace_set_filename(char *filename);
+void trace_set_filename(Picoc *pc, const char *filename);
 
-const char* trace_get_stdout_file();
+const char* trace_get_stdout_file(Picoc *pc);
 
-const char* trace_get_trace_file();
+const char* trace_get_trace_file(Picoc *pc);
 
 void trace_state_print (struct ParseState *Parser);
 
@@ -4,10 +4,65 @@
 #include "interpreter.h"
 
 /* some basic types */
-static int PointerAlignBytes;
-static int IntAlignBytes;
 
 
+/* hash a type by the things which make it unique */
+static unsigned int TypeHash(struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier)
+{
+    unsigned long Hash = ((unsigned long)ParentType >> 3) * 31 + ((unsigned long)Identifier >> 3);
+    
+    Hash = Hash * 31 + (unsigned long)Base;
+    Hash = Hash * 31 + (unsigned long)ArraySize;
+    Hash ^= Hash >> 16;
+    Hash *= 0x45d9f3bUL;
+    Hash ^= Hash >> 16;
+    
+    return (unsigned int)Hash;
+}
+
+/* double the size of the type intern table */
+static void TypeHashGrow(Picoc *pc)
+{
+    int NewSize = pc->TypeHashSize * 2;
+    struct ValueType **NewHashTable = HeapAllocMem(pc, sizeof(struct ValueType *) * NewSize);
+    struct ValueType *Typ;
+    struct ValueType *NextTyp;
+    unsigned int Slot;
+    int Count;
+    
+    if (NewHashTable == NULL)
+        ProgramFailNoParser(pc, "out of memory");
+    
+    for (Count = 0; Count < pc->TypeHashSize; Count++)
+    {
+        for (Typ = pc->TypeHashTable[Count]; Typ != NULL; Typ = NextTyp)
+        {
+            NextTyp = Typ->HashNext;
+            Slot = TypeHash(Typ->FromType, Typ->Base, Typ->ArraySize, Typ->Identifier) & (NewSize - 1);
+            Typ->HashNext = NewHashTable[Slot];
+            NewHashTable[Slot] = Typ;
+        }
+    }
+    
+    HeapFreeMem(pc, pc->TypeHashTable);
+    pc->TypeHashTable = NewHashTable;
+    pc->TypeHashSize = NewSize;
+}
+
+/* add a type to the type intern table */
+static void TypeHashAdd(Picoc *pc, struct ValueType *Typ)
+{
+    unsigned int Slot;
+    
+    if (pc->TypeHashCount >= pc->TypeHashSize)
+        TypeHashGrow(pc);
+    
+    Slot = TypeHash(Typ->FromType, Typ->Base, Typ->ArraySize, Typ->Identifier) & (pc->TypeHashSize - 1);
+    Typ->HashNext = pc->TypeHashTable[Slot];
+    pc->TypeHashTable[Slot] = Typ;
+    pc->TypeHashCount++;
+}
+
 /* add a new type to the set of types we know about */
 struct ValueType *TypeAdd(Picoc *pc, struct ParseState *Parser, struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier, int Sizeof, int AlignBytes)
 {
@@ -23,19 +78,29 @@ struct ValueType *TypeAdd(Picoc *pc, struct ParseState *Parser, struct ValueType
     NewType->OnHeap = TRUE;
     NewType->Next = ParentType->DerivedTypeList;
     ParentType->DerivedTypeList = NewType;
+    TypeHashAdd(pc, NewType);
     
     return NewType;
 }
 
+/* find an existing derived type, returning NULL if there isn't one.
+ * Identifier should be registered with the shared string table. */
+struct ValueType *TypeLookup(Picoc *pc, struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier)
+{
+    struct ValueType *ThisType = pc->TypeHashTable[TypeHash(ParentType, Base, ArraySize, Identifier) & (pc->TypeHashSize - 1)];
+    while (ThisType != NULL && (ThisType->FromType != ParentType || ThisType->Base != Base || ThisType->ArraySize != ArraySize || ThisType->Identifier != Identifier))
+        ThisType = ThisType->HashNext;
+    
+    return ThisType;
+}
+
 /* given a parent type, get a matching derived type and make one if necessary.
  * Identifier should be registered with the shared string table. */
 struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser, struct ValueType *ParentType, enum BaseType Base, int ArraySize, const char *Identifier, int AllowDuplicates)
 {
     int Sizeof;
     int AlignBytes;
-    struct ValueType *ThisType = ParentType->DerivedTypeList;
-    while (ThisType != NULL && (ThisType->Base != Base || ThisType->ArraySize != ArraySize || ThisType->Identifier != Identifier))
-        ThisType = ThisType->Next;
+    struct ValueType *ThisType = TypeLookup(pc, ParentType, Base, ArraySize, Identifier);
     
     if (ThisType != NULL)
     {
@@ -47,9 +112,9 @@ struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser, struct V
         
     switch (Base)
     {
-        case TypePointer:   Sizeof = sizeof(void *); AlignBytes = PointerAlignBytes; break;
+        case TypePointer:   Sizeof = sizeof(void *); AlignBytes = pc->PointerAlignBytes; break;
         case TypeArray:     Sizeof = ArraySize * ParentType->Sizeof; AlignBytes = ParentType->AlignBytes; break;
-        case TypeEnum:      Sizeof = sizeof(int); AlignBytes = IntAlignBytes; break;
+        case TypeEnum:      Sizeof = sizeof(int); AlignBytes = pc->IntAlignBytes; break;
         default:            Sizeof = 0; AlignBytes = 0; break;      /* structs and unions will get bigger when we add members to them */
     }
 
@@ -101,6 +166,7 @@ void TypeAddBaseType(Picoc *pc, struct ValueType *TypeNode, enum BaseType Base,
     TypeNode->OnHeap = FALSE;
     TypeNode->Next = pc->UberType.DerivedTypeList;
     pc->UberType.DerivedTypeList = TypeNode;
+    TypeHashAdd(pc, TypeNode);
 }
 
 /* initialise the type system */
@@ -115,32 +181,40 @@ void TypeInit(Picoc *pc)
 #endif
     struct PointerAlign { char x; void *y; } pa;
     
-    IntAlignBytes = (char *)&ia.y - &ia.x;
-    PointerAlignBytes = (char *)&pa.y - &pa.x;
+    pc->IntAlignBytes = (char *)&ia.y - &ia.x;
+    pc->PointerAlignBytes = (char *)&pa.y - &pa.x;
+    strcpy(pc->StructTempName, "^s0000");
+    strcpy(pc->EnumTempName, "^e0000");
+    
+    pc->TypeHashSize = TYPE_TABLE_SIZE;
+    pc->TypeHashCount = 0;
+    pc->TypeHashTable = HeapAllocMem(pc, sizeof(struct ValueType *) * TYPE_TABLE_SIZE);
+    if (pc->TypeHashTable == NULL)
+        ProgramFailNoParser(pc, "out of memory");
     
     pc->UberType.DerivedTypeList = NULL;
-    TypeAddBaseType(pc, &pc->IntType, TypeInt, sizeof(int), IntAlignBytes);
+    TypeAddBaseType(pc, &pc->IntType, TypeInt, sizeof(int), pc->IntAlignBytes);
     TypeAddBaseType(pc, &pc->ShortType, TypeShort, sizeof(short), (char *)&sa.y - &sa.x);
     TypeAddBaseType(pc, &pc->CharType, TypeChar, sizeof(char), (char *)&ca.y - &ca.x);
     TypeAddBaseType(pc, &pc->LongType, TypeLong, sizeof(long), (char *)&la.y - &la.x);
-    TypeAddBaseType(pc, &pc->UnsignedIntType, TypeUnsignedInt, sizeof(unsigned int), IntAlignBytes);
+    TypeAddBaseType(pc, &pc->UnsignedIntType, TypeUnsignedInt, sizeof(unsigned int), pc->IntAlignBytes);
     TypeAddBaseType(pc, &pc->UnsignedShortType, TypeUnsignedShort, sizeof(unsigned short), (char *)&sa.y - &sa.x);
     TypeAddBaseType(pc, &pc->UnsignedLongType, TypeUnsignedLong, sizeof(unsigned long), (char *)&la.y - &la.x);
     TypeAddBaseType(pc, &pc->UnsignedCharType, TypeUnsignedChar, sizeof(unsigned char), (char *)&ca.y - &ca.x);
     TypeAddBaseType(pc, &pc->VoidType, TypeVoid, 0, 1);
-    TypeAddBaseType(pc, &pc->FunctionType, TypeFunction, sizeof(int), IntAlignBytes);
-    TypeAddBaseType(pc, &pc->MacroType, TypeMacro, sizeof(int), IntAlignBytes);
+    TypeAddBaseType(pc, &pc->FunctionType, TypeFunction, sizeof(int), pc->IntAlignBytes);
+    TypeAddBaseType(pc, &pc->MacroType, TypeMacro, sizeof(int), pc->IntAlignBytes);
     TypeAddBaseType(pc, &pc->GotoLabelType, TypeGotoLabel, 0, 1);
 #ifndef NO_FP
     TypeAddBaseType(pc, &pc->FPType, TypeFP, sizeof(double), (char *)&da.y - &da.x);
     TypeAddBaseType(pc, &pc->TypeType, Type_Type, sizeof(double), (char *)&da.y - &da.x);  /* must be large enough to cast to a double */
 #else
-    TypeAddBaseType(pc, &pc->TypeType, Type_Type, sizeof(struct ValueType *), PointerAlignBytes);
+    TypeAddBaseType(pc, &pc->TypeType, Type_Type, sizeof(struct ValueType *), pc->PointerAlignBytes);
 #endif
     pc->CharArrayType = TypeAdd(pc, NULL, &pc->CharType, TypeArray, 0, pc->StrEmpty, sizeof(char), (char *)&ca.y - &ca.x);
-    pc->CharPtrType = TypeAdd(pc, NULL, &pc->CharType, TypePointer, 0, pc->StrEmpty, sizeof(void *), PointerAlignBytes);
-    pc->CharPtrPtrType = TypeAdd(pc, NULL, pc->CharPtrType, TypePointer, 0, pc->StrEmpty, sizeof(void *), PointerAlignBytes);
-    pc->VoidPtrType = TypeAdd(pc, NULL, &pc->VoidType, TypePointer, 0, pc->StrEmpty, sizeof(void *), PointerAlignBytes);
+    pc->CharPtrType = TypeAdd(pc, NULL, &pc->CharType, TypePointer, 0, pc->StrEmpty, sizeof(void *), pc->PointerAlignBytes);
+    pc->CharPtrPtrType = TypeAdd(pc, NULL, pc->CharPtrType, TypePointer, 0, pc->StrEmpty, sizeof(void *), pc->PointerAlignBytes);
+    pc->VoidPtrType = TypeAdd(pc, NULL, &pc->VoidType, TypePointer, 0, pc->StrEmpty, sizeof(void *), pc->PointerAlignBytes);
 }
 
 /* deallocate heap-allocated types */
@@ -172,6 +246,8 @@ void TypeCleanupNode(Picoc *pc, struct ValueType *Typ)
 void TypeCleanup(Picoc *pc)
 {
     TypeCleanupNode(pc, &pc->UberType);
+    HeapFreeMem(pc, pc->TypeHashTable);
+    pc->TypeHashTable = NULL;
 }
 
 /* parse a struct or union declaration */
@@ -195,8 +271,7 @@ void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ, int IsSt
     }
     else
     {
-        static char TempNameBuf[7] = "^s0000";
-        StructIdentifier = PlatformMakeTempName(pc, TempNameBuf);
+        StructIdentifier = PlatformMakeTempName(pc, pc->StructTempName);
     }
 
     *Typ = TypeGetMatching(pc, Parser, &Parser->pc->UberType, IsStruct ? TypeStruct : TypeUnion, 0, StructIdentifier, TRUE);
@@ -301,8 +376,7 @@ void TypeParseEnum(struct ParseState *Parser, struct ValueType **Typ)
     }
     else
     {
-        static char TempNameBuf[7] = "^e0000";
-        EnumIdentifier = PlatformMakeTempName(pc, TempNameBuf);
+        EnumIdentifier = PlatformMakeTempName(pc, pc->EnumTempName);
     }
 
     TypeGetMatching(pc, Parser, &pc->UberType, TypeEnum, 0, EnumIdentifier, Token != TokenLeftBrace);
@@ -335,7 +409,7 @@ void TypeParseEnum(struct ParseState *Parser, struct ValueType **Typ)
             EnumValue = ExpressionParseInt(Parser);
         }
         
-        VariableDefine(pc, Parser, EnumIdentifier, &InitValue, NULL, FALSE);
+        VariableDefine(pc, Parser, EnumIdentifier, &InitValue, NULL, FALSE)->IsConstant = TRUE;
             
         Token = LexGetToken(Parser, NULL, TRUE);
         if (Token != TokenComma && Token != TokenRightBrace)
@@ -42,20 +42,21 @@ void VariableFree(Picoc *pc, struct Value *Val)
 void VariableTableCleanup(Picoc *pc, struct Table *HashTable)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     int Count;
     
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
-        {
-            NextEntry = Entry->Next;
-            VariableFree(pc, Entry->p.v.Val);
-                
-            /* free the hash table entry */
-            HeapFreeMem(pc, Entry);
-        }
+        Entry = HashTable->HashTable[Count];
+        if (Entry == NULL)
+            continue;
+        
+        VariableFree(pc, Entry->p.v.Val);
+            
+        /* free the hash table entry */
+        HeapFreeMem(pc, Entry);
     }
+    
+    TableFreeHashTable(pc, HashTable);
 }
 
 void VariableCleanup(Picoc *pc)
@@ -75,7 +76,13 @@ void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
         NewValue = HeapAllocStack(pc, Size);
     
     if (NewValue == NULL)
-        ProgramFail(Parser, "out of memory");
+    {
+        /* tables are added to without a parser */
+        if (Parser == NULL)
+            ProgramFailNoParser(pc, OnHeap ? "out of memory" : "stack overflow");
+            
+        ProgramFail(Parser, OnHeap ? "out of memory" : "stack overflow");
+    }
     
 #ifdef DEBUG_HEAP
     if (!OnHeap)
@@ -85,24 +92,51 @@ void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
     return NewValue;
 }
 
-/* allocate a value either on the heap or the stack using space dependent on what type we want */
-struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser, int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap)
+/* like VariableAlloc() but the memory isn't cleared - the caller must fill all of it in */
+void *VariableAllocUninitialised(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
+{
+    void *NewValue;
+    
+    if (OnHeap)
+        NewValue = HeapAllocMemUninitialised(pc, Size);
+    else
+        NewValue = HeapAllocStackUninitialised(pc, Size);
+    
+    if (NewValue == NULL)
+    {
+        /* tables are added to without a parser */
+        if (Parser == NULL)
+            ProgramFailNoParser(pc, OnHeap ? "out of memory" : "stack overflow");
+            
+        ProgramFail(Parser, OnHeap ? "out of memory" : "stack overflow");
+    }
+    
+    return NewValue;
+}
+
+/* fill in the fields of a value which has its data straight after it */
+static struct Value *VariableInitValue(struct ParseState *Parser, struct Value *NewValue, int IsLValue, struct Value *LValueFrom, int OnHeap)
 {
-    struct Value *NewValue = VariableAlloc(pc, Parser, MEM_ALIGN(sizeof(struct Value)) + DataSize, OnHeap);
     NewValue->Val = (union AnyValue *)((char *)NewValue + MEM_ALIGN(sizeof(struct Value)));
     NewValue->ValOnHeap = OnHeap;
     NewValue->AnyValOnHeap = FALSE;
     NewValue->ValOnStack = !OnHeap;
     NewValue->IsLValue = IsLValue;
+    NewValue->IsConstant = FALSE;
     NewValue->LValueFrom = LValueFrom;
-    if (Parser) 
-        NewValue->ScopeID = Parser->ScopeID;
-
+    NewValue->ScopeID = (Parser != NULL) ? Parser->ScopeID : SCOPE_ID_NONE;
     NewValue->OutOfScope = 0;
     
     return NewValue;
 }
 
+/* allocate a value either on the heap or the stack using space dependent on what type we want */
+struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser, int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap)
+{
+    struct Value *NewValue = VariableAlloc(pc, Parser, MEM_ALIGN(sizeof(struct Value)) + DataSize, OnHeap);
+    return VariableInitValue(Parser, NewValue, IsLValue, LValueFrom, OnHeap);
+}
+
 /* allocate a value given its type */
 struct Value *VariableAllocValueFromType(Picoc *pc, struct ParseState *Parser, struct ValueType *Typ, int IsLValue, struct Value *LValueFrom, int OnHeap)
 {
@@ -124,7 +158,8 @@ struct Value *VariableAllocValueAndCopy(Picoc *pc, struct ParseState *Parser, st
 
     assert(CopySize <= MAX_TMP_COPY_BUF);
     memcpy((void *)&TmpBuf[0], (void *)FromValue->Val, CopySize);
-    NewValue = VariableAllocValueAndData(pc, Parser, CopySize, FromValue->IsLValue, FromValue->LValueFrom, OnHeap);
+    NewValue = VariableAllocUninitialised(pc, Parser, MEM_ALIGN(sizeof(struct Value)) + CopySize, OnHeap);
+    VariableInitValue(Parser, NewValue, FromValue->IsLValue, FromValue->LValueFrom, OnHeap);
     NewValue->Typ = DType;
     memcpy((void *)NewValue->Val, (void *)&TmpBuf[0], CopySize);
     
@@ -134,14 +169,17 @@ struct Value *VariableAllocValueAndCopy(Picoc *pc, struct ParseState *Parser, st
 /* allocate a value either on the heap or the stack from an existing AnyValue and type */
 struct Value *VariableAllocValueFromExistingData(struct ParseState *Parser, struct ValueType *Typ, union AnyValue *FromValue, int IsLValue, struct Value *LValueFrom)
 {
-    struct Value *NewValue = VariableAlloc(Parser->pc, Parser, sizeof(struct Value), FALSE);
+    struct Value *NewValue = VariableAllocUninitialised(Parser->pc, Parser, sizeof(struct Value), FALSE);
     NewValue->Typ = Typ;
     NewValue->Val = FromValue;
     NewValue->ValOnHeap = FALSE;
     NewValue->AnyValOnHeap = FALSE;
     NewValue->ValOnStack = FALSE;
     NewValue->IsLValue = IsLValue;
+    NewValue->IsConstant = FALSE;
     NewValue->LValueFrom = LValueFrom;
+    NewValue->ScopeID = SCOPE_ID_NONE;
+    NewValue->OutOfScope = 0;
     
     return NewValue;
 }
@@ -165,7 +203,6 @@ void VariableRealloc(struct ParseState *Parser, struct Value *FromValue, int New
 int VariableScopeBegin(struct ParseState * Parser, int* OldScopeID)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     Picoc * pc = Parser->pc;
     int Count;
     #ifdef VAR_SCOPE_DEBUG
@@ -174,29 +211,33 @@ int VariableScopeBegin(struct ParseState * Parser, int* OldScopeID)
     
     struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
 
-    if (Parser->ScopeID == -1) return -1;
+    if (Parser->ScopeID == SCOPE_ID_NONE) return SCOPE_ID_NONE;
 
     /* XXX dumb hash, let's hope for no collisions... */
     *OldScopeID = Parser->ScopeID;
-    Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) * ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
+    if (Parser->SourceText != NULL)
+        Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) * ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
+    else
+        Parser->ScopeID = (int)(intptr_t)(Parser->Pos) / sizeof(char*);     /* interactive input has no source text */
+    
+    /* a block mustn't end the scope of values which are outside every block */
+    if (Parser->ScopeID == SCOPE_ID_NONE || Parser->ScopeID == SCOPE_ID_TOP_LEVEL)
+        Parser->ScopeID = SCOPE_ID_TOP_LEVEL + 1;
     /* or maybe a more human-readable hash for debugging? */
     /* Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos; */
     
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
+        Entry = HashTable->HashTable[Count];
+        if (Entry != NULL && Entry->p.v.Val->ScopeID == Parser->ScopeID && Entry->p.v.Val->OutOfScope)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == Parser->ScopeID && Entry->p.v.Val->OutOfScope)
-            {
-                Entry->p.v.Val->OutOfScope = FALSE;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
-                #ifdef VAR_SCOPE_DEBUG
-                if (!FirstPrint) { PRINT_SOURCE_POS; }
-                FirstPrint = 1;
-                printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-            }
+            Entry->p.v.Val->OutOfScope = FALSE;
+            Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
+            #ifdef VAR_SCOPE_DEBUG
+            if (!FirstPrint) { PRINT_SOURCE_POS; }
+            FirstPrint = 1;
+            printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+            #endif
         }
     }
 
@@ -206,7 +247,6 @@ int VariableScopeBegin(struct ParseState * Parser, int* OldScopeID)
 void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int PrevScopeID)
 {
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
     Picoc * pc = Parser->pc;
     int Count;
     #ifdef VAR_SCOPE_DEBUG
@@ -215,23 +255,21 @@ void VariableScopeEnd(struct ParseState * Parser, int ScopeID, int PrevScopeID)
 
     struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
 
-    if (ScopeID == -1) return;
+    /* values defined with no parser are SCOPE_ID_NONE so they're never matched */
+    if (ScopeID == SCOPE_ID_NONE) return;
 
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = NextEntry)
+        Entry = HashTable->HashTable[Count];
+        if (Entry != NULL && Entry->p.v.Val->ScopeID == ScopeID && !Entry->p.v.Val->OutOfScope)
         {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == ScopeID && !Entry->p.v.Val->OutOfScope)
-            {
-                #ifdef VAR_SCOPE_DEBUG
-                if (!FirstPrint) { PRINT_SOURCE_POS; }
-                FirstPrint = 1;
-                printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
-                #endif
-                Entry->p.v.Val->OutOfScope = TRUE;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
-            }
+            #ifdef VAR_SCOPE_DEBUG
+            if (!FirstPrint) { PRINT_SOURCE_POS; }
+            FirstPrint = 1;
+            printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key, Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+            #endif
+            Entry->p.v.Val->OutOfScope = TRUE;
+            Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
         }
     }
 
@@ -246,11 +284,9 @@ int VariableDefinedAndOutOfScope(Picoc * pc, const char* Ident)
     struct Table * HashTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
     for (Count = 0; Count < HashTable->Size; Count++)
     {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL; Entry = Entry->Next)
-        {
-            if (Entry->p.v.Val->OutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
-                return TRUE;
-        }
+        Entry = HashTable->HashTable[Count];
+        if (Entry != NULL && Entry->p.v.Val->OutOfScope && (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
+            return TRUE;
     }
     return FALSE;
 }
@@ -261,7 +297,7 @@ struct Value *VariableDefine(Picoc *pc, struct ParseState *Parser, char *Ident,
     struct Value * AssignValue;
     struct Table * currentTable = (pc->TopStackFrame == NULL) ? &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
     
-    int ScopeID = Parser ? Parser->ScopeID : -1;
+    int ScopeID = Parser ? Parser->ScopeID : SCOPE_ID_NONE;
 #ifdef VAR_SCOPE_DEBUG
     if (Parser) fprintf(stderr, "def %s %x (%s:%d:%d)\n", Ident, ScopeID, Parser->FileName, Parser->Line, Parser->CharacterPos);
 #endif
@@ -300,6 +336,17 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *
         char *MNPos = &MangledName[0];
         char *MNEnd = &MangledName[LINEBUFFER_MAX-1];
         const char *RegisteredMangledName;
+        const char *FuncName = (pc->TopStackFrame != NULL) ? pc->TopStackFrame->FuncName : NULL;
+        struct StaticCacheEntry *Cache = &pc->StaticCache[STATIC_CACHE_HASH(Parser->Pos)];
+        
+        /* have we already resolved this declaration? the mangled name only depends 
+         * on the file, function and identifier so if they match it's the same static */
+        if (Cache->Pos == Parser->Pos && Cache->FileName == Parser->FileName && Cache->FuncName == FuncName && Cache->Identifier == Ident)
+        {
+            ExistingValue = Cache->Storage;
+            VariableDefinePlatformVar(Parser->pc, Parser, Ident, ExistingValue->Typ, ExistingValue->Val, TRUE);
+            return ExistingValue;
+        }
         
         /* make the mangled static name (avoiding using sprintf() to minimise library impact) */
         memset((void *)&MangledName, '\0', sizeof(MangledName));
@@ -307,11 +354,11 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *
         strncpy(MNPos, (char *)Parser->FileName, MNEnd - MNPos);
         MNPos += strlen(MNPos);
         
-        if (pc->TopStackFrame != NULL)
+        if (FuncName != NULL)
         {
             /* we're inside a function */
             if (MNEnd - MNPos > 0) *MNPos++ = '/';
-            strncpy(MNPos, (char *)pc->TopStackFrame->FuncName, MNEnd - MNPos);
+            strncpy(MNPos, (char *)FuncName, MNEnd - MNPos);
             MNPos += strlen(MNPos);
         }
             
@@ -328,6 +375,12 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser, char *
             *FirstVisit = TRUE;
         }
 
+        Cache->Pos = Parser->Pos;
+        Cache->FileName = Parser->FileName;
+        Cache->FuncName = FuncName;
+        Cache->Identifier = Ident;
+        Cache->Storage = ExistingValue;
+
         /* static variable exists in the global scope - now make a mirroring variable in our own scope with the short name */
         VariableDefinePlatformVar(Parser->pc, Parser, Ident, ExistingValue->Typ, ExistingValue->Val, TRUE);
         return ExistingValue;
@@ -356,10 +409,11 @@ int VariableDefined(Picoc *pc, const char *Ident)
     return TRUE;
 }
 
-/* get the value of a variable. must be defined. Ident must be registered */
+/* get the value of a variable. must be defined. Ident must be registered.
+ * a macro body only sees its own parameters and the globals, not the caller's locals */
 void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, struct Value **LVal)
 {
-    if (pc->TopStackFrame == NULL || !TableGet(&pc->TopStackFrame->LocalTable, Ident, LVal, NULL, NULL, NULL))
+    if (pc->TopStackFrame == NULL || (Parser != NULL && Parser->MacroArgs != NULL) || !TableGet(&pc->TopStackFrame->LocalTable, Ident, LVal, NULL, NULL, NULL))
     {
         if (!TableGet(&pc->GlobalTable, Ident, LVal, NULL, NULL, NULL))
         {
@@ -368,6 +422,10 @@ void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident, struct
             else
                 ProgramFail(Parser, "'%s' is undefined", Ident);
         }
+        
+        /* library functions are only parsed when they're first used */
+        if ((*LVal)->Typ == &pc->FunctionType && (*LVal)->Val->FuncDef.ReturnType == NULL)
+            *LVal = LibraryResolve(pc, Ident, *LVal);
     }
 }
 
@@ -412,15 +470,22 @@ void VariableStackPop(struct ParseState *Parser, struct Value *Var)
 void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName, int NumParams)
 {
     struct StackFrame *NewFrame;
+    char Here;
+    
+    /* each call also nests deeper in the C stack */
+    if ((unsigned long)&Here < Parser->pc->CStackLimit)
+        ProgramFail(Parser, "stack overflow");
     
     HeapPushStackFrame(Parser->pc);
-    NewFrame = HeapAllocStack(Parser->pc, sizeof(struct StackFrame) + sizeof(struct Value *) * NumParams);
-    if (NewFrame == NULL)
-        ProgramFail(Parser, "out of memory");
-        
+    NewFrame = VariableAllocUninitialised(Parser->pc, Parser, sizeof(struct StackFrame) + sizeof(struct Value *) * NumParams, FALSE);
     ParserCopy(&NewFrame->ReturnParser, Parser);
     NewFrame->FuncName = FuncName;
+    NewFrame->ReturnValue = NULL;
+    NewFrame->NumParams = NumParams;
     NewFrame->Parameter = (NumParams > 0) ? ((void *)((char *)NewFrame + sizeof(struct StackFrame))) : NULL;
+    if (NumParams > 0)
+        memset((void *)NewFrame->Parameter, '\0', sizeof(struct Value *) * NumParams);
+        
     TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalHashTable[0], LOCAL_TABLE_SIZE, FALSE);
     NewFrame->PreviousStackFrame = Parser->pc->TopStackFrame;
     Parser->pc->TopStackFrame = NewFrame;
@@ -433,6 +498,7 @@ void VariableStackFramePop(struct ParseState *Parser)
         ProgramFail(Parser, "stack is empty - can't go back");
         
     ParserCopy(Parser, &Parser->pc->TopStackFrame->ReturnParser);
+    TableFreeHashTable(Parser->pc, &Parser->pc->TopStackFrame->LocalTable);
     Parser->pc->TopStackFrame = Parser->pc->TopStackFrame->PreviousStackFrame;
     HeapPopStackFrame(Parser->pc);
 }